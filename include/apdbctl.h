@@ -0,0 +1,276 @@
+#ifndef APDBCTL_H
+#define APDBCTL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(APDBCTL_BUILDING_LIBRARY)
+#define APDBCTL_EXPORT __attribute__((visibility("default")))
+#else
+#define APDBCTL_EXPORT
+#endif
+
+/**
+ * @brief Status codes returned by the library, identical to the exit codes of `apdbctl`.
+ */
+enum apdbctl_status {
+  APDBCTL_SUCCESS = 0,
+  APDBCTL_ERR_INVALID_ARGUMENT = 1,
+  APDBCTL_ERR_DEVICE_NOT_FOUND = 2,
+  APDBCTL_ERR_HIDAPI_CALL_FAIL = 3,
+  APDBCTL_ERR_INVALID_PRECONDITION = 4,
+};
+
+/**
+ * @brief Interpolation curves of `apdbctl_fade`.
+ */
+enum apdbctl_curve {
+  APDBCTL_CURVE_LINEAR = 0,
+  APDBCTL_CURVE_EASE = 1,
+  APDBCTL_CURVE_PERCEPTUAL = 2,
+};
+
+#define APDBCTL_BRIGHTNESS_MIN 400
+#define APDBCTL_BRIGHTNESS_MAX 50000
+
+/**
+ * @brief An open brightness control device of an Apple Pro Display XDR.
+ *
+ * A context is meant to be kept for the lifetime of the embedding process: the device is looked up
+ * once, and reopened transparently when its handle goes stale (e.g. after the display was
+ * power-cycled). A context must not be used by several threads at the same time. Each call locks
+ * the displays like `apdbctl` does, so that the reports of other programs do not interleave.
+ */
+typedef struct apdbctl apdbctl;
+
+/**
+ * @brief Opens the brightness control device of a display.
+ *
+ * @param context[out] The new context, to release with `apdbctl_close`.
+ * @param serial[in] The serial number of the display to open, or NULL for the first display.
+ *
+ * @retval APDBCTL_SUCCESS The device was opened.
+ * @retval APDBCTL_ERR_DEVICE_NOT_FOUND No matching display is connected.
+ * @retval APDBCTL_ERR_INVALID_PRECONDITION Out of memory, or too many processes wait for the
+ *   displays.
+ */
+APDBCTL_EXPORT int apdbctl_open(apdbctl** context, const char* serial);
+
+/**
+ * @brief Closes the device and releases the context. Accepts NULL.
+ */
+APDBCTL_EXPORT void apdbctl_close(apdbctl* context);
+
+/**
+ * @brief Returns the serial number of the open display, empty if unknown.
+ */
+APDBCTL_EXPORT const char* apdbctl_serial(const apdbctl* context);
+
+/**
+ * @brief Describes the last HID failure of a call made on the calling thread, empty if none.
+ *
+ * The library does not print anything: after a call returned `APDBCTL_ERR_DEVICE_NOT_FOUND` or
+ * `APDBCTL_ERR_HIDAPI_CALL_FAIL`, this tells which HID call failed and why. Requests of the
+ * asynchronous interface run on its I/O thread, and only report their status.
+ */
+APDBCTL_EXPORT const char* apdbctl_last_error(void);
+
+/**
+ * @brief Reads the absolute brightness, in [APDBCTL_BRIGHTNESS_MIN, APDBCTL_BRIGHTNESS_MAX].
+ *
+ * @retval APDBCTL_SUCCESS `brightness` holds the current brightness.
+ * @retval APDBCTL_ERR_DEVICE_NOT_FOUND The display was disconnected.
+ * @retval APDBCTL_ERR_HIDAPI_CALL_FAIL The device did not answer.
+ * @retval APDBCTL_ERR_INVALID_PRECONDITION Too many processes wait for the displays.
+ */
+APDBCTL_EXPORT int apdbctl_get(apdbctl* context, uint32_t* brightness);
+
+/**
+ * @brief Sets the absolute brightness, in [APDBCTL_BRIGHTNESS_MIN, APDBCTL_BRIGHTNESS_MAX].
+ *
+ * @retval APDBCTL_SUCCESS The brightness was sent to the display.
+ * @retval APDBCTL_ERR_INVALID_ARGUMENT `brightness` is out of range.
+ * @retval APDBCTL_ERR_DEVICE_NOT_FOUND The display was disconnected.
+ * @retval APDBCTL_ERR_HIDAPI_CALL_FAIL The device did not answer.
+ * @retval APDBCTL_ERR_INVALID_PRECONDITION Too many processes wait for the displays.
+ */
+APDBCTL_EXPORT int apdbctl_set(apdbctl* context, uint32_t brightness);
+
+/**
+ * @brief Sets the brightness as a percentage, in [0, 100].
+ *
+ * @see apdbctl_set
+ */
+APDBCTL_EXPORT int apdbctl_set_percent(apdbctl* context, uint32_t percent);
+
+/**
+ * @brief Fades from the current brightness to `brightness` over `duration_ns`, blocking until done.
+ *
+ * Steps are paced at 100 Hz against absolute deadlines, and dropped rather than delayed when the
+ * display falls behind.
+ *
+ * @see apdbctl_set
+ */
+APDBCTL_EXPORT int apdbctl_fade(apdbctl* context, uint32_t brightness, uint64_t duration_ns,
+                                enum apdbctl_curve curve);
+
+/**
+ * @brief Asynchronous interface, for event loops that must never block on HID I/O.
+ *
+ * Requests are queued to an I/O thread owning its own context, and executed in submission order.
+ * A set submitted while the previous request in the queue is a set that has not started yet
+ * replaces it: only the most recent brightness is sent to the display, and the replaced requests
+ * complete with its outcome. Completions are retrieved in submission order with
+ * `apdbctl_async_next`, and signaled by `apdbctl_async_fd` becoming readable.
+ */
+typedef struct apdbctl_async apdbctl_async;
+
+enum apdbctl_operation {
+  APDBCTL_OPERATION_GET = 1,
+  APDBCTL_OPERATION_SET = 2,
+};
+
+/**
+ * @brief The outcome of an asynchronous request.
+ *
+ * @param id The identifier returned when the request was submitted.
+ * @param collapsed For sets, the number of earlier sets replaced by this one before they started.
+ *   Their identifiers are `id - collapsed` to `id - 1`, and they share this outcome.
+ * @param operation The operation of the request.
+ * @param status One of `APDBCTL_SUCCESS` or `APDBCTL_ERR_*`.
+ * @param brightness The absolute brightness read, or sent to the display.
+ */
+struct apdbctl_completion {
+  uint64_t id;
+  uint32_t collapsed;
+  enum apdbctl_operation operation;
+  int status;
+  uint32_t brightness;
+};
+
+/**
+ * @brief Starts the I/O thread of a display. Does not perform any HID I/O on the calling thread.
+ *
+ * The display is opened by the I/O thread on the first request, and requests complete with
+ * `APDBCTL_ERR_DEVICE_NOT_FOUND` until it is connected.
+ *
+ * @param async[out] The new asynchronous context, to release with `apdbctl_async_close`.
+ * @param serial[in] The serial number of the display to open, or NULL for the first display.
+ *
+ * @retval APDBCTL_SUCCESS The I/O thread is running.
+ * @retval APDBCTL_ERR_INVALID_PRECONDITION Out of memory, file descriptors or threads.
+ */
+APDBCTL_EXPORT int apdbctl_async_open(apdbctl_async** async, const char* serial);
+
+/**
+ * @brief Waits for the request in progress, discards pending requests and releases the context.
+ */
+APDBCTL_EXPORT void apdbctl_async_close(apdbctl_async* async);
+
+/**
+ * @brief Returns a non-blocking file descriptor that is readable while completions are pending.
+ *
+ * Register it with `poll`, `epoll`, GLib or libuv for reading; do not read from it or close it.
+ */
+APDBCTL_EXPORT int apdbctl_async_fd(const apdbctl_async* async);
+
+/**
+ * @brief Queues a brightness read.
+ *
+ * @param id[out] The identifier of the request, or NULL.
+ *
+ * @retval APDBCTL_SUCCESS The request was queued.
+ * @retval APDBCTL_ERR_INVALID_PRECONDITION Too many requests not yet retrieved.
+ */
+APDBCTL_EXPORT int apdbctl_async_get(apdbctl_async* async, uint64_t* id);
+
+/**
+ * @brief Queues a brightness update, in [APDBCTL_BRIGHTNESS_MIN, APDBCTL_BRIGHTNESS_MAX].
+ *
+ * @param id[out] The identifier of the request, or NULL.
+ *
+ * @retval APDBCTL_SUCCESS The request was queued.
+ * @retval APDBCTL_ERR_INVALID_ARGUMENT `brightness` is out of range.
+ * @retval APDBCTL_ERR_INVALID_PRECONDITION Too many requests not yet retrieved.
+ */
+APDBCTL_EXPORT int apdbctl_async_set(apdbctl_async* async, uint32_t brightness, uint64_t* id);
+
+/**
+ * @brief Queues a brightness update as a percentage, in [0, 100].
+ *
+ * @see apdbctl_async_set
+ */
+APDBCTL_EXPORT int apdbctl_async_set_percent(apdbctl_async* async, uint32_t percent, uint64_t* id);
+
+/**
+ * @brief Retrieves the next completion, without blocking.
+ *
+ * @param completion[out] The completion.
+ *
+ * @retval 1 `completion` holds the next completion.
+ * @retval 0 No request completed since the last call.
+ */
+APDBCTL_EXPORT int apdbctl_async_next(apdbctl_async* async, struct apdbctl_completion* completion);
+
+/**
+ * @brief Read-only view of the brightness published by a running `apdbctld`.
+ *
+ * The daemon keeps the brightness of its display in a file of `$XDG_RUNTIME_DIR/apdbctl`, updated
+ * from the input reports the display sends on changes. Once the file is mapped, reading it takes
+ * no syscall and no HID I/O, which suits status bars and widgets refreshing often. A view may be
+ * read by several threads at the same time.
+ */
+typedef struct apdbctl_cache apdbctl_cache;
+
+/**
+ * @brief A consistent copy of the status published by the daemon.
+ *
+ * @param brightness The absolute brightness.
+ * @param changed_ns When the brightness or the connection of the display last changed, in
+ *   nanoseconds since the Unix epoch.
+ * @param updated_ns When the brightness was last read from or sent to the display, in nanoseconds
+ *   since the Unix epoch.
+ * @param daemon_pid The process ID of the daemon, to check that it is still running.
+ */
+struct apdbctl_cached_status {
+  uint32_t brightness;
+  uint64_t changed_ns;
+  uint64_t updated_ns;
+  int32_t daemon_pid;
+};
+
+/**
+ * @brief Maps the status published by the daemon. Remains valid across daemon restarts.
+ *
+ * @param cache[out] The new view, to release with `apdbctl_cache_close`.
+ *
+ * @retval APDBCTL_SUCCESS The status was mapped.
+ * @retval APDBCTL_ERR_INVALID_PRECONDITION No daemon ever ran in this session, or out of memory.
+ */
+APDBCTL_EXPORT int apdbctl_cache_open(apdbctl_cache** cache);
+
+/**
+ * @brief Unmaps the status and releases the view. Accepts NULL.
+ */
+APDBCTL_EXPORT void apdbctl_cache_close(apdbctl_cache* cache);
+
+/**
+ * @brief Reads the status published by the daemon, without any syscall.
+ *
+ * @param status[out] The status.
+ *
+ * @retval APDBCTL_SUCCESS `status` holds the brightness of the display.
+ * @retval APDBCTL_ERR_DEVICE_NOT_FOUND The display is disconnected, or the daemon stopped.
+ * @retval APDBCTL_ERR_INVALID_PRECONDITION The daemon was killed while updating the status.
+ */
+APDBCTL_EXPORT int apdbctl_cache_read(const apdbctl_cache* cache,
+                                      struct apdbctl_cached_status* status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // APDBCTL_H
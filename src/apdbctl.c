@@ -0,0 +1,281 @@
+#include <apdbctl.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "brightness.h"
+#include "device.h"
+#include "fade.h"
+#include "lock.h"
+#include "status.h"
+
+_Static_assert(APDBCTL_SUCCESS == SUCCESS, "status codes must match exit codes");
+_Static_assert(APDBCTL_ERR_INVALID_ARGUMENT == ERR_INVALID_ARGUMENT,
+               "status codes must match exit codes");
+_Static_assert(APDBCTL_ERR_DEVICE_NOT_FOUND == ERR_DEVICE_NOT_FOUND,
+               "status codes must match exit codes");
+_Static_assert(APDBCTL_ERR_HIDAPI_CALL_FAIL == ERR_HIDAPI_CALL_FAIL,
+               "status codes must match exit codes");
+_Static_assert(APDBCTL_ERR_INVALID_PRECONDITION == ERR_INVALID_PRECONDITION,
+               "status codes must match exit codes");
+_Static_assert(APDBCTL_BRIGHTNESS_MIN == BRIGHTNESS_MIN && APDBCTL_BRIGHTNESS_MAX == BRIGHTNESS_MAX,
+               "brightness range must match");
+_Static_assert((int)APDBCTL_CURVE_LINEAR == (int)FADE_CURVE_LINEAR &&
+                   (int)APDBCTL_CURVE_EASE == (int)FADE_CURVE_EASE &&
+                   (int)APDBCTL_CURVE_PERCEPTUAL == (int)FADE_CURVE_PERCEPTUAL,
+               "curves must match");
+
+/**
+ * @brief A library context.
+ *
+ * @param display The open display. Its device is NULL after a failed reopen.
+ * @param serial The serial number of the selected display, or empty for the first display.
+ */
+struct apdbctl {
+  struct display display;
+  char serial[sizeof(((struct display*)0)->serial)];
+};
+
+/**
+ * @brief Opens the selected display into the context.
+ *
+ * @param context[in,out] The context.
+ * @return Whether the display was opened.
+ */
+static bool apdbctl_reopen(apdbctl* context) {
+  struct display_selector selector = {
+      .serial = *context->serial ? context->serial : NULL,
+      .index = -1,
+  };
+
+  close_displays(&context->display, 1);
+  if (!open_displays(&selector, &context->display, 1)) {
+    context->display.device = NULL;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Waits for other processes to be done with the displays, like `apdbctl` does.
+ *
+ * @param lock[out] The lock, to release with `device_lock_release`.
+ * @return Whether the displays are available, or false if too many processes are waiting.
+ */
+static bool apdbctl_lock(struct device_lock* lock) {
+  return device_lock_acquire(lock, DEVICE_LOCK_WAIT_FOREVER);
+}
+
+/**
+ * @brief Returns the device of the context, reopening it if a previous call left it closed.
+ */
+static struct device* apdbctl_device(apdbctl* context) {
+  if (!context->display.device && !apdbctl_reopen(context)) {
+    return NULL;
+  }
+  return context->display.device;
+}
+
+int apdbctl_open(apdbctl** context, const char* serial) {
+  // Errors are returned to the embedding process, see `apdbctl_last_error`.
+  device_errors_printed = false;
+
+  *context = calloc(1, sizeof(**context));
+  if (!*context) {
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+  if (serial) {
+    snprintf((*context)->serial, sizeof((*context)->serial), "%s", serial);
+  }
+
+  struct device_lock lock;
+  if (!apdbctl_lock(&lock)) {
+    free(*context);
+    *context = NULL;
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+  bool opened = apdbctl_reopen(*context);
+  device_lock_release(&lock);
+  if (!opened) {
+    free(*context);
+    *context = NULL;
+    return APDBCTL_ERR_DEVICE_NOT_FOUND;
+  }
+  return APDBCTL_SUCCESS;
+}
+
+void apdbctl_close(apdbctl* context) {
+  if (!context) {
+    return;
+  }
+  close_displays(&context->display, 1);
+  free(context);
+}
+
+const char* apdbctl_serial(const apdbctl* context) {
+  return context->display.serial;
+}
+
+/**
+ * @brief Reads the brightness, with the displays locked.
+ *
+ * @see apdbctl_get
+ */
+static int apdbctl_get_locked(apdbctl* context, uint32_t* brightness) {
+  struct device* device = apdbctl_device(context);
+  if (!device) {
+    return APDBCTL_ERR_DEVICE_NOT_FOUND;
+  }
+
+  int32_t value = hid_get_brightness(device);
+  if (value < 0) {
+    // The handle is presumably stale, e.g. after the display was power-cycled: retry once.
+    if (!apdbctl_reopen(context)) {
+      return APDBCTL_ERR_DEVICE_NOT_FOUND;
+    }
+    value = hid_get_brightness(context->display.device);
+  }
+  if (value < 0) {
+    return APDBCTL_ERR_HIDAPI_CALL_FAIL;
+  }
+
+  *brightness = value;
+  return APDBCTL_SUCCESS;
+}
+
+const char* apdbctl_last_error(void) {
+  return device_last_error();
+}
+
+int apdbctl_get(apdbctl* context, uint32_t* brightness) {
+  struct device_lock lock;
+  if (!apdbctl_lock(&lock)) {
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+  int status = apdbctl_get_locked(context, brightness);
+  device_lock_release(&lock);
+  return status;
+}
+
+/**
+ * @brief Sets the brightness, with the displays locked.
+ *
+ * @see apdbctl_set
+ */
+static int apdbctl_set_locked(apdbctl* context, uint32_t brightness) {
+  struct device* device = apdbctl_device(context);
+  if (!device) {
+    return APDBCTL_ERR_DEVICE_NOT_FOUND;
+  }
+
+  if (hid_set_brightness(device, brightness)) {
+    return APDBCTL_SUCCESS;
+  }
+
+  // The handle is presumably stale, e.g. after the display was power-cycled: retry once.
+  if (!apdbctl_reopen(context)) {
+    return APDBCTL_ERR_DEVICE_NOT_FOUND;
+  }
+  return hid_set_brightness(context->display.device, brightness) ? APDBCTL_SUCCESS
+                                                                 : APDBCTL_ERR_HIDAPI_CALL_FAIL;
+}
+
+int apdbctl_set(apdbctl* context, uint32_t brightness) {
+  if (brightness < BRIGHTNESS_MIN || brightness > BRIGHTNESS_MAX) {
+    return APDBCTL_ERR_INVALID_ARGUMENT;
+  }
+
+  struct device_lock lock;
+  if (!apdbctl_lock(&lock)) {
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+  int status = apdbctl_set_locked(context, brightness);
+  device_lock_release(&lock);
+  return status;
+}
+
+int apdbctl_set_percent(apdbctl* context, uint32_t percent) {
+  if (percent > 100) {
+    return APDBCTL_ERR_INVALID_ARGUMENT;
+  }
+  return apdbctl_set(context, to_absolute_brightness(percent));
+}
+
+int apdbctl_fade(apdbctl* context, uint32_t brightness, uint64_t duration_ns,
+                 enum apdbctl_curve curve) {
+  if (brightness < BRIGHTNESS_MIN || brightness > BRIGHTNESS_MAX ||
+      (unsigned int)curve > APDBCTL_CURVE_PERCEPTUAL) {
+    return APDBCTL_ERR_INVALID_ARGUMENT;
+  }
+
+  // Held for the whole fade, so that the steps of other processes do not interleave.
+  struct device_lock lock;
+  if (!apdbctl_lock(&lock)) {
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+
+  uint32_t current;
+  int status = apdbctl_get_locked(context, &current);
+  if (status == APDBCTL_SUCCESS) {
+    // A fade is not retried: resuming it after reopening the device would replay elapsed steps.
+    struct fade_statistics statistics;
+    if (!fade_brightness(context->display.device, current, brightness, /* start_ns= */ 0,
+                         duration_ns, (enum fade_curve)curve, &statistics)) {
+      close_displays(&context->display, 1);
+      status = APDBCTL_ERR_HIDAPI_CALL_FAIL;
+    }
+  }
+  device_lock_release(&lock);
+  return status;
+}
+
+/**
+ * @brief A view of the status page of the daemon.
+ *
+ * @param page The status page, mapped for reading.
+ */
+struct apdbctl_cache {
+  const struct status_page* page;
+};
+
+int apdbctl_cache_open(apdbctl_cache** cache) {
+  const struct status_page* page = status_page_map();
+  if (!page) {
+    *cache = NULL;
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+
+  *cache = malloc(sizeof(**cache));
+  if (!*cache) {
+    status_page_unmap(page);
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+  (*cache)->page = page;
+  return APDBCTL_SUCCESS;
+}
+
+void apdbctl_cache_close(apdbctl_cache* cache) {
+  if (!cache) {
+    return;
+  }
+  status_page_unmap(cache->page);
+  free(cache);
+}
+
+int apdbctl_cache_read(const apdbctl_cache* cache, struct apdbctl_cached_status* status) {
+  struct status_snapshot snapshot;
+  if (!status_page_read(cache->page, &snapshot)) {
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+
+  *status = (struct apdbctl_cached_status){
+      .brightness = snapshot.brightness,
+      .changed_ns = snapshot.changed_ns,
+      .updated_ns = snapshot.updated_ns,
+      .daemon_pid = snapshot.pid,
+  };
+  return snapshot.state == STATUS_CONNECTED && snapshot.brightness ? APDBCTL_SUCCESS
+                                                                   : APDBCTL_ERR_DEVICE_NOT_FOUND;
+}
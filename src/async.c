@@ -0,0 +1,331 @@
+#include <apdbctl.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "brightness.h"
+
+// The maximum number of requests submitted but not yet retrieved with `apdbctl_async_next`.
+#define ASYNC_CAPACITY 256
+
+/**
+ * @brief A request waiting for the I/O thread.
+ *
+ * @param id The identifier of the most recent submission merged into this request.
+ * @param collapsed The number of earlier sets this request replaced.
+ * @param operation The operation to execute.
+ * @param brightness The absolute brightness to set.
+ */
+struct async_request {
+  uint64_t id;
+  uint32_t collapsed;
+  enum apdbctl_operation operation;
+  uint32_t brightness;
+};
+
+/**
+ * @brief An asynchronous context.
+ *
+ * Both queues are rings. Their combined size, plus the request in progress, never exceeds
+ * `ASYNC_CAPACITY`, so that neither overflows.
+ *
+ * @param thread The I/O thread.
+ * @param mutex Protects every other field, except the file descriptors and `serial`.
+ * @param submitted Signaled when a request is queued, or the context is closing.
+ * @param fd The file descriptor readable while completions are pending.
+ * @param notify_fd The file descriptor written to make `fd` readable: `fd` itself for an eventfd,
+ *   or the write end of a pipe.
+ * @param serial The serial number of the display, or empty for the first display.
+ * @param requests The requests waiting for the I/O thread.
+ * @param completions The completions waiting to be retrieved.
+ * @param busy Whether the I/O thread is executing a request.
+ * @param closing Whether the I/O thread must stop.
+ * @param next_id The identifier of the next request.
+ */
+struct apdbctl_async {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t submitted;
+  int fd;
+  int notify_fd;
+  char serial[64];
+
+  struct async_request requests[ASYNC_CAPACITY];
+  size_t request_head;
+  size_t request_count;
+
+  struct apdbctl_completion completions[ASYNC_CAPACITY];
+  size_t completion_head;
+  size_t completion_count;
+
+  bool busy;
+  bool closing;
+  uint64_t next_id;
+};
+
+/**
+ * @brief Makes the completion file descriptor readable. Must be called with the context locked.
+ */
+static void async_notify(apdbctl_async* async) {
+#if defined(__linux__)
+  uint64_t value = 1;
+#else
+  unsigned char value = 0;
+#endif
+  while (write(async->notify_fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+  }
+}
+
+/**
+ * @brief Makes the completion file descriptor not readable. Must be called with the context locked.
+ */
+static void async_drain(apdbctl_async* async) {
+  unsigned char buffer[64];
+  for (;;) {
+    ssize_t bytes_read = read(async->fd, buffer, sizeof(buffer));
+    if (bytes_read <= 0 && !(bytes_read < 0 && errno == EINTR)) {
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Executes a request on the I/O thread, opening the display if needed.
+ *
+ * @param context[in,out] The context of the I/O thread, NULL until the display is found.
+ * @param serial[in] The serial number of the display, or empty for the first display.
+ * @param request[in] The request to execute.
+ * @param completion[out] The outcome of the request.
+ */
+static void async_execute(apdbctl** context, const char* serial,
+                          const struct async_request* request,
+                          struct apdbctl_completion* completion) {
+  *completion = (struct apdbctl_completion){
+      .id = request->id,
+      .collapsed = request->collapsed,
+      .operation = request->operation,
+      .brightness = request->brightness,
+  };
+
+  if (!*context) {
+    completion->status = apdbctl_open(context, *serial ? serial : NULL);
+    if (completion->status != APDBCTL_SUCCESS) {
+      return;
+    }
+  }
+
+  if (request->operation == APDBCTL_OPERATION_SET) {
+    completion->status = apdbctl_set(*context, request->brightness);
+  } else {
+    completion->status = apdbctl_get(*context, &completion->brightness);
+  }
+}
+
+/**
+ * @brief Executes requests in submission order until the context is closed.
+ *
+ * @param argument[in,out] The asynchronous context.
+ * @return NULL.
+ */
+static void* async_run(void* argument) {
+  apdbctl_async* async = argument;
+  apdbctl* context = NULL;
+
+  pthread_mutex_lock(&async->mutex);
+  for (;;) {
+    while (!async->request_count && !async->closing) {
+      pthread_cond_wait(&async->submitted, &async->mutex);
+    }
+    if (async->closing) {
+      break;
+    }
+
+    struct async_request request = async->requests[async->request_head];
+    async->request_head = (async->request_head + 1) % ASYNC_CAPACITY;
+    --async->request_count;
+    async->busy = true;
+    pthread_mutex_unlock(&async->mutex);
+
+    struct apdbctl_completion completion;
+    async_execute(&context, async->serial, &request, &completion);
+
+    pthread_mutex_lock(&async->mutex);
+    async->busy = false;
+    async->completions[(async->completion_head + async->completion_count++) % ASYNC_CAPACITY] =
+        completion;
+    if (async->completion_count == 1) {
+      async_notify(async);
+    }
+  }
+  pthread_mutex_unlock(&async->mutex);
+
+  apdbctl_close(context);
+  return NULL;
+}
+
+/**
+ * @brief Creates the completion file descriptor: an eventfd on Linux, a pipe elsewhere.
+ *
+ * @return Whether the file descriptor was created.
+ */
+static bool async_create_fd(apdbctl_async* async) {
+#if defined(__linux__)
+  async->fd = async->notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  return async->fd >= 0;
+#else
+  int fds[2];
+  if (pipe(fds) < 0) {
+    return false;
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+  }
+  async->fd = fds[0];
+  async->notify_fd = fds[1];
+  return true;
+#endif
+}
+
+static void async_close_fd(apdbctl_async* async) {
+  if (async->notify_fd != async->fd) {
+    close(async->notify_fd);
+  }
+  close(async->fd);
+}
+
+int apdbctl_async_open(apdbctl_async** async, const char* serial) {
+  *async = calloc(1, sizeof(**async));
+  if (!*async) {
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+
+  apdbctl_async* self = *async;
+  pthread_mutex_init(&self->mutex, NULL);
+  pthread_cond_init(&self->submitted, NULL);
+  self->next_id = 1;
+  if (serial) {
+    snprintf(self->serial, sizeof(self->serial), "%s", serial);
+  }
+
+  if (!async_create_fd(self)) {
+    free(self);
+    *async = NULL;
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+  if (pthread_create(&self->thread, NULL, async_run, self)) {
+    async_close_fd(self);
+    free(self);
+    *async = NULL;
+    return APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+  return APDBCTL_SUCCESS;
+}
+
+void apdbctl_async_close(apdbctl_async* async) {
+  if (!async) {
+    return;
+  }
+
+  pthread_mutex_lock(&async->mutex);
+  async->closing = true;
+  pthread_cond_signal(&async->submitted);
+  pthread_mutex_unlock(&async->mutex);
+  pthread_join(async->thread, NULL);
+
+  async_close_fd(async);
+  pthread_cond_destroy(&async->submitted);
+  pthread_mutex_destroy(&async->mutex);
+  free(async);
+}
+
+int apdbctl_async_fd(const apdbctl_async* async) {
+  return async->fd;
+}
+
+/**
+ * @brief Queues a request, replacing the last queued request if both are sets.
+ *
+ * @param async[in,out] The asynchronous context.
+ * @param operation[in] The operation of the request.
+ * @param brightness[in] The absolute brightness to set.
+ * @param id[out] The identifier of the request, or NULL.
+ * @return `APDBCTL_SUCCESS`, or `APDBCTL_ERR_INVALID_PRECONDITION` if the context is full.
+ */
+static int async_submit(apdbctl_async* async, enum apdbctl_operation operation,
+                        uint32_t brightness, uint64_t* id) {
+  int status = APDBCTL_SUCCESS;
+
+  pthread_mutex_lock(&async->mutex);
+  struct async_request* last =
+      async->request_count
+          ? &async->requests[(async->request_head + async->request_count - 1) % ASYNC_CAPACITY]
+          : NULL;
+
+  if (operation == APDBCTL_OPERATION_SET && last && last->operation == APDBCTL_OPERATION_SET) {
+    // The queued set has not started yet: it would be overwritten right away.
+    last->id = async->next_id;
+    last->brightness = brightness;
+    ++last->collapsed;
+  } else if (async->request_count + async->completion_count + async->busy < ASYNC_CAPACITY) {
+    async->requests[(async->request_head + async->request_count++) % ASYNC_CAPACITY] =
+        (struct async_request){
+            .id = async->next_id,
+            .operation = operation,
+            .brightness = brightness,
+        };
+    pthread_cond_signal(&async->submitted);
+  } else {
+    status = APDBCTL_ERR_INVALID_PRECONDITION;
+  }
+
+  if (status == APDBCTL_SUCCESS && id) {
+    *id = async->next_id;
+  }
+  if (status == APDBCTL_SUCCESS) {
+    ++async->next_id;
+  }
+  pthread_mutex_unlock(&async->mutex);
+  return status;
+}
+
+int apdbctl_async_get(apdbctl_async* async, uint64_t* id) {
+  return async_submit(async, APDBCTL_OPERATION_GET, 0, id);
+}
+
+int apdbctl_async_set(apdbctl_async* async, uint32_t brightness, uint64_t* id) {
+  if (brightness < BRIGHTNESS_MIN || brightness > BRIGHTNESS_MAX) {
+    return APDBCTL_ERR_INVALID_ARGUMENT;
+  }
+  return async_submit(async, APDBCTL_OPERATION_SET, brightness, id);
+}
+
+int apdbctl_async_set_percent(apdbctl_async* async, uint32_t percent, uint64_t* id) {
+  if (percent > 100) {
+    return APDBCTL_ERR_INVALID_ARGUMENT;
+  }
+  return async_submit(async, APDBCTL_OPERATION_SET, to_absolute_brightness(percent), id);
+}
+
+int apdbctl_async_next(apdbctl_async* async, struct apdbctl_completion* completion) {
+  pthread_mutex_lock(&async->mutex);
+  bool available = async->completion_count > 0;
+  if (available) {
+    *completion = async->completions[async->completion_head];
+    async->completion_head = (async->completion_head + 1) % ASYNC_CAPACITY;
+    if (!--async->completion_count) {
+      async_drain(async);
+    }
+  }
+  pthread_mutex_unlock(&async->mutex);
+  return available;
+}
@@ -0,0 +1,402 @@
+#include "batch.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "brightness.h"
+#include "clock.h"
+#include "device.h"
+#include "lock.h"
+
+#define BATCH_QUEUE_CAPACITY 64
+#define BATCH_LINE_MAX 256
+#define BATCH_READ_SIZE 4096
+
+enum batch_operation {
+  BATCH_GET,
+  BATCH_SET,
+  BATCH_SLEEP,
+  BATCH_INVALID,
+  BATCH_END,
+};
+
+/**
+ * @brief A parsed batch command.
+ *
+ * @param operation The operation to execute.
+ * @param line The line number of the command in the input, for error reporting.
+ * @param value The brightness value for `BATCH_SET`.
+ * @param as_percentage_point Whether `value` is a percentage for `BATCH_SET`, or whether to print
+ *   the brightness as a percentage for `BATCH_GET`.
+ * @param duration_ns The duration of `BATCH_SLEEP`, in nanoseconds.
+ */
+struct batch_command {
+  enum batch_operation operation;
+  unsigned int line;
+  uint32_t value;
+  bool as_percentage_point;
+  uint64_t duration_ns;
+};
+
+/**
+ * @brief A bounded single-producer, single-consumer queue of parsed commands.
+ *
+ * @param input_fd The file descriptor commands are read from.
+ * @param wake_fd The read end of a pipe that becomes readable when the consumer stops, so that the
+ *   producer stops waiting for input.
+ * @param commands The ring buffer of parsed commands.
+ * @param head The index of the next command to execute.
+ * @param size The number of commands in the queue.
+ * @param cancelled Whether the consumer stopped, in which case the producer stops too.
+ */
+struct batch_queue {
+  int input_fd;
+  int wake_fd;
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  struct batch_command commands[BATCH_QUEUE_CAPACITY];
+  size_t head;
+  size_t size;
+  bool cancelled;
+};
+
+/**
+ * @brief Parses a line of batch input.
+ *
+ * @param line[in,out] The line to parse, modified in place.
+ * @param command[out] The parsed command. Its operation is `BATCH_INVALID` on error.
+ * @return Whether the line holds a command, as opposed to being blank or a comment.
+ */
+static bool parse_batch_command(char* line, struct batch_command* command) {
+  char* arguments[3];
+  int argc = 0;
+
+  line[strcspn(line, "#")] = '\0';
+  for (char *save, *token = strtok_r(line, " \t\r\n", &save); token;
+       token = strtok_r(NULL, " \t\r\n", &save)) {
+    if (argc == 3) {
+      command->operation = BATCH_INVALID;
+      return true;
+    }
+    arguments[argc++] = token;
+  }
+
+  if (argc == 0) {
+    return false;
+  }
+
+  command->operation = BATCH_INVALID;
+
+  if (!strcmp(arguments[0], "get")) {
+    if (argc == 1 || !strcmp(arguments[1], "-%") || !strcmp(arguments[1], "-p") ||
+        !strcmp(arguments[1], "--percent")) {
+      command->operation = BATCH_GET;
+      command->as_percentage_point = argc == 2;
+    }
+  } else if (!strcmp(arguments[0], "set")) {
+    if (argc == 2 && parse_brightness_parameter(arguments[1], &command->value,
+                                                &command->as_percentage_point)) {
+      command->operation = BATCH_SET;
+    }
+  } else if (!strcmp(arguments[0], "sleep")) {
+    if (argc == 2 && parse_duration(arguments[1], &command->duration_ns)) {
+      command->operation = BATCH_SLEEP;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Pushes a command to the queue, waiting for room if needed.
+ *
+ * @param queue[in,out] The queue.
+ * @param command[in] The command to push.
+ * @return Whether the consumer is still running.
+ */
+static bool batch_queue_push(struct batch_queue* queue, const struct batch_command* command) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->size == BATCH_QUEUE_CAPACITY && !queue->cancelled) {
+    pthread_cond_wait(&queue->not_full, &queue->mutex);
+  }
+  bool cancelled = queue->cancelled;
+  if (!cancelled) {
+    queue->commands[(queue->head + queue->size++) % BATCH_QUEUE_CAPACITY] = *command;
+    pthread_cond_signal(&queue->not_empty);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  return !cancelled;
+}
+
+/**
+ * @brief Pops the next command from the queue, waiting for one if needed.
+ *
+ * @param queue[in,out] The queue.
+ * @param command[out] The next command.
+ */
+static void batch_queue_pop(struct batch_queue* queue, struct batch_command* command) {
+  pthread_mutex_lock(&queue->mutex);
+  while (queue->size == 0) {
+    pthread_cond_wait(&queue->not_empty, &queue->mutex);
+  }
+  *command = queue->commands[queue->head];
+  queue->head = (queue->head + 1) % BATCH_QUEUE_CAPACITY;
+  --queue->size;
+  pthread_cond_signal(&queue->not_full);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+/**
+ * @brief The buffered input of the parser.
+ *
+ * @param buffer The bytes read but not consumed yet, from `start` to `end`.
+ */
+struct batch_reader {
+  char buffer[BATCH_READ_SIZE];
+  size_t start;
+  size_t end;
+};
+
+enum batch_line {
+  BATCH_LINE,
+  BATCH_LINE_TOO_LONG,
+  BATCH_LINE_END,
+};
+
+/**
+ * @brief Reads the next line of the input, unless the consumer stops first.
+ *
+ * Lines longer than `size` are consumed whole, rather than split into several commands. The last
+ * line may lack a newline.
+ *
+ * @param queue[in] The queue, holding the input and the wake-up pipe.
+ * @param reader[in,out] The buffered input.
+ * @param line[out] The line, NUL-terminated, including its newline if any.
+ * @param size[in] The size of `line`.
+ *
+ * @retval BATCH_LINE A line was read into `line`.
+ * @retval BATCH_LINE_TOO_LONG A line was consumed, but did not fit into `line`.
+ * @retval BATCH_LINE_END The input ended, failed, or the consumer stopped.
+ */
+static enum batch_line batch_read_line(const struct batch_queue* queue,
+                                       struct batch_reader* reader, char* line, size_t size) {
+  size_t length = 0;
+  bool too_long = false;
+
+  for (;;) {
+    while (reader->start < reader->end) {
+      char c = reader->buffer[reader->start++];
+      if (length + 1 < size) {
+        line[length++] = c;
+      } else {
+        too_long = true;
+      }
+      if (c == '\n') {
+        line[length] = '\0';
+        return too_long ? BATCH_LINE_TOO_LONG : BATCH_LINE;
+      }
+    }
+
+    struct pollfd fds[] = {
+        {.fd = queue->input_fd, .events = POLLIN},
+        {.fd = queue->wake_fd, .events = POLLIN},
+    };
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return BATCH_LINE_END;
+    }
+    if (fds[1].revents) {
+      return BATCH_LINE_END;
+    }
+
+    ssize_t bytes_read = read(queue->input_fd, reader->buffer, sizeof(reader->buffer));
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      line[length] = '\0';
+      return too_long ? BATCH_LINE_TOO_LONG : length ? BATCH_LINE : BATCH_LINE_END;
+    }
+    reader->start = 0;
+    reader->end = bytes_read;
+  }
+}
+
+/**
+ * @brief Reads and parses the input, ahead of execution.
+ *
+ * Runs on its own thread so that reading and parsing the next lines overlaps the feature report in
+ * flight on the executing thread.
+ *
+ * @param argument[in,out] The queue.
+ * @return NULL.
+ */
+static void* batch_parse(void* argument) {
+  struct batch_queue* queue = argument;
+  struct batch_reader reader = {0};
+  char line[BATCH_LINE_MAX];
+  struct batch_command command = {0};
+  enum batch_line read;
+
+  while ((read = batch_read_line(queue, &reader, line, sizeof(line))) != BATCH_LINE_END) {
+    ++command.line;
+    bool parsed = read == BATCH_LINE_TOO_LONG || parse_batch_command(line, &command);
+    if (read == BATCH_LINE_TOO_LONG) {
+      command.operation = BATCH_INVALID;
+    }
+    if (parsed && !batch_queue_push(queue, &command)) {
+      return NULL;
+    }
+  }
+
+  command.operation = BATCH_END;
+  batch_queue_push(queue, &command);
+  return NULL;
+}
+
+/**
+ * @brief Waits for other invocations to be done with the displays.
+ *
+ * @param lock[out] The lock, to release with `device_lock_release`.
+ * @param timeout_ns[in] How long to wait at most, or `DEVICE_LOCK_WAIT_FOREVER`.
+ * @return Whether the displays are available.
+ */
+static bool batch_lock(struct device_lock* lock, uint64_t timeout_ns) {
+  if (device_lock_acquire(lock, timeout_ns)) {
+    return true;
+  }
+  if (lock->queue_full) {
+    fprintf(stderr, "error: displays busy, too many invocations waiting.\n");
+  } else {
+    fprintf(stderr, "error: displays busy, gave up after %.1fms.\n", lock->waited_ns / 1e6);
+  }
+  return false;
+}
+
+/**
+ * @brief Executes newline-delimited brightness commands against a single device handle.
+ *
+ * Supported commands are `get [-%]`, `set <value>` and `sleep <duration>`. Blank lines and `#`
+ * comments are ignored. Invalid lines are reported and skipped; a HID failure stops the batch.
+ * The displays are locked while the device is opened and for each command, but not across sleeps
+ * or while waiting for input, so that other invocations can take turns.
+ *
+ * @param selector[in] The display to operate on. Must select a single display.
+ * @param input[in] The stream to read commands from, not read from before.
+ * @param lock_timeout_ns[in] How long to wait for other invocations at most, for each command.
+ *
+ * @retval SUCCESS All commands executed successfully.
+ * @retval ERR_INVALID_ARGUMENT At least one line was invalid.
+ * @retval ERR_DEVICE_NOT_FOUND Apple Pro Display XDR brightness control device not found.
+ * @retval ERR_HIDAPI_CALL_FAIL Failed to send or retrieve HID feature report.
+ * @retval ERR_INVALID_PRECONDITION Other invocations held the displays longer than
+ *   `lock_timeout_ns`.
+ */
+int run_batch(const struct display_selector* selector, FILE* input, uint64_t lock_timeout_ns) {
+  struct device_lock lock;
+  if (!batch_lock(&lock, lock_timeout_ns)) {
+    return ERR_INVALID_PRECONDITION;
+  }
+  struct display display;
+  bool opened = open_displays(selector, &display, 1);
+  device_lock_release(&lock);
+  if (!opened) {
+    fprintf(stderr, "error: Apple Pro Display XDR brightness control device not found.\n");
+    return ERR_DEVICE_NOT_FOUND;
+  }
+  struct device* device = display.device;
+
+  int wake[2];
+  if (pipe(wake)) {
+    fprintf(stderr, "error: failed to start batch parser.\n");
+    close_device(device);
+    return ERR_INVALID_PRECONDITION;
+  }
+
+  struct batch_queue queue = {
+      .input_fd = fileno(input),
+      .wake_fd = wake[0],
+      .mutex = PTHREAD_MUTEX_INITIALIZER,
+      .not_empty = PTHREAD_COND_INITIALIZER,
+      .not_full = PTHREAD_COND_INITIALIZER,
+  };
+
+  pthread_t parser;
+  if (pthread_create(&parser, NULL, batch_parse, &queue)) {
+    fprintf(stderr, "error: failed to start batch parser.\n");
+    close(wake[0]);
+    close(wake[1]);
+    close_device(device);
+    return ERR_INVALID_PRECONDITION;
+  }
+
+  int status = SUCCESS;
+
+  for (;;) {
+    struct batch_command command;
+    batch_queue_pop(&queue, &command);
+
+    if (command.operation == BATCH_END) {
+      break;
+    } else if (command.operation == BATCH_INVALID) {
+      fprintf(stderr, "error: line %u: invalid command.\n", command.line);
+      status = ERR_INVALID_ARGUMENT;
+    } else if (command.operation == BATCH_SLEEP) {
+      sleep_until(monotonic_ns() + command.duration_ns);
+    } else if (!batch_lock(&lock, lock_timeout_ns)) {
+      status = ERR_INVALID_PRECONDITION;
+      break;
+    } else if (command.operation == BATCH_SET) {
+      uint32_t brightness = command.as_percentage_point ? to_absolute_brightness(command.value)
+                                                        : command.value;
+      bool sent = hid_set_brightness(device, brightness);
+      device_lock_release(&lock);
+      if (!sent) {
+        status = ERR_HIDAPI_CALL_FAIL;
+        break;
+      }
+    } else {
+      int32_t brightness = hid_get_brightness(device);
+      device_lock_release(&lock);
+      if (brightness < 0) {
+        status = ERR_HIDAPI_CALL_FAIL;
+        break;
+      }
+      if (command.as_percentage_point) {
+        printf("%u%%\n", to_percent_brightness(brightness));
+      } else {
+        printf("%u\n", brightness);
+      }
+      fflush(stdout);
+    }
+  }
+
+  if (status == ERR_HIDAPI_CALL_FAIL || status == ERR_INVALID_PRECONDITION) {
+    // The parser may be waiting for room in the queue, or for input: stop it rather than waiting
+    // for EOF.
+    pthread_mutex_lock(&queue.mutex);
+    queue.cancelled = true;
+    pthread_cond_signal(&queue.not_full);
+    pthread_mutex_unlock(&queue.mutex);
+    close(wake[1]);
+    wake[1] = -1;
+    fprintf(stderr, "error: batch aborted.\n");
+  }
+  pthread_join(parser, NULL);
+  close(wake[0]);
+  if (wake[1] >= 0) {
+    close(wake[1]);
+  }
+
+  close_device(device);
+  return status;
+}
@@ -0,0 +1,11 @@
+#ifndef APDBCTL_BATCH_H
+#define APDBCTL_BATCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "device.h"
+
+int run_batch(const struct display_selector* selector, FILE* input, uint64_t lock_timeout_ns);
+
+#endif  // APDBCTL_BATCH_H
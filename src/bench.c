@@ -0,0 +1,524 @@
+#include "bench.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <hidapi.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "brightness.h"
+#include "clock.h"
+#include "descriptor.h"
+
+#if defined(__linux__)
+#include "protocol.h"
+#include "runtime.h"
+
+// Spawning the running executable rather than `argv[0]` avoids timing a `PATH` lookup.
+#define BENCH_SELF_EXECUTABLE "/proc/self/exe"
+// Spawned daemons are terminated after their first request: they never reach their idle timeout.
+#define BENCH_IDLE_TIMEOUT "60s"
+#endif
+
+extern char** environ;
+
+/**
+ * @brief The latencies of a measured operation.
+ *
+ * @param mode The name of the benchmark mode.
+ * @param phase The name of the operation.
+ * @param samples_ns The latency of each successful iteration, in nanoseconds.
+ * @param count The number of successful iterations.
+ * @param failures The number of failed iterations, not part of `samples_ns`.
+ */
+struct bench_series {
+  const char* mode;
+  const char* phase;
+  uint64_t* samples_ns;
+  size_t count;
+  size_t failures;
+};
+
+bool parse_bench_mode(const char* parameter, unsigned int* mode) {
+  if (!strcmp(parameter, "phases")) {
+    *mode = BENCH_MODE_PHASES;
+  } else if (!strcmp(parameter, "warm")) {
+    *mode = BENCH_MODE_WARM;
+  } else if (!strcmp(parameter, "cold")) {
+    *mode = BENCH_MODE_COLD;
+  } else if (!strcmp(parameter, "daemon")) {
+    *mode = BENCH_MODE_DAEMON;
+  } else if (!strcmp(parameter, "spawn")) {
+    *mode = BENCH_MODE_SPAWN;
+  } else if (!strcmp(parameter, "all")) {
+    *mode = BENCH_MODE_ALL;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool bench_series_init(struct bench_series* series, const char* mode, const char* phase,
+                              size_t capacity) {
+  *series = (struct bench_series){.mode = mode, .phase = phase};
+  series->samples_ns = malloc(capacity * sizeof(*series->samples_ns));
+  if (!series->samples_ns) {
+    fprintf(stderr, "error: failed to allocate %zu samples.\n", capacity);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Records the outcome of an iteration that started at `start_ns`.
+ *
+ * @param series[in,out] The series to record the iteration in.
+ * @param start_ns[in] The start of the iteration, on the monotonic clock.
+ * @param success[in] Whether the iteration succeeded.
+ * @return `success`.
+ */
+static bool bench_series_record(struct bench_series* series, uint64_t start_ns, bool success) {
+  uint64_t elapsed_ns = monotonic_ns() - start_ns;
+  if (success) {
+    series->samples_ns[series->count++] = elapsed_ns;
+  } else {
+    ++series->failures;
+  }
+  return success;
+}
+
+static int compare_samples(const void* lhs, const void* rhs) {
+  uint64_t left = *(const uint64_t*)lhs;
+  uint64_t right = *(const uint64_t*)rhs;
+  return (left > right) - (left < right);
+}
+
+/**
+ * @brief Returns the nearest-rank percentile of sorted samples.
+ */
+static uint64_t percentile(const uint64_t* sorted, size_t count, unsigned int rank) {
+  size_t index = (count * rank + 99) / 100;
+  return sorted[index ? index - 1 : 0];
+}
+
+/**
+ * @brief Prints the latency distribution of a series on the standard output, and releases it.
+ *
+ * Throughput is the number of successful iterations per second spent in them, i.e. the rate of
+ * back-to-back operations.
+ *
+ * @param series[in,out] The series to report.
+ * @param json[in] Whether to print a JSON object rather than a table row.
+ */
+static void bench_series_report(struct bench_series* series, bool json) {
+  uint64_t total_ns = 0;
+  for (size_t i = 0; i < series->count; ++i) {
+    total_ns += series->samples_ns[i];
+  }
+  qsort(series->samples_ns, series->count, sizeof(*series->samples_ns), compare_samples);
+
+  uint64_t p50_ns = 0, p90_ns = 0, p99_ns = 0, max_ns = 0;
+  if (series->count) {
+    p50_ns = percentile(series->samples_ns, series->count, 50);
+    p90_ns = percentile(series->samples_ns, series->count, 90);
+    p99_ns = percentile(series->samples_ns, series->count, 99);
+    max_ns = series->samples_ns[series->count - 1];
+  }
+  double throughput = total_ns ? (double)series->count * NANOSECONDS_PER_SECOND / total_ns : 0;
+
+  if (json) {
+    printf("{\"mode\":\"%s\",\"phase\":\"%s\",\"iterations\":%zu,\"failures\":%zu,"
+           "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,"
+           "\"throughput_per_s\":%.1f}\n",
+           series->mode, series->phase, series->count, series->failures,
+           (unsigned long long)p50_ns, (unsigned long long)p90_ns, (unsigned long long)p99_ns,
+           (unsigned long long)max_ns, throughput);
+  } else {
+    printf("%-7s %-19s %7zu %6zu %10.3f %10.3f %10.3f %10.3f %10.1f\n", series->mode,
+           series->phase, series->count, series->failures, p50_ns / 1e6, p90_ns / 1e6,
+           p99_ns / 1e6, max_ns / 1e6, throughput);
+  }
+  fflush(stdout);
+
+  free(series->samples_ns);
+  series->samples_ns = NULL;
+}
+
+static void bench_print_header(bool json) {
+  if (!json) {
+    printf("%-7s %-19s %7s %6s %10s %10s %10s %10s %10s\n", "mode", "phase", "n", "failed",
+           "p50 (ms)", "p90 (ms)", "p99 (ms)", "max (ms)", "ops/s");
+  }
+}
+
+/**
+ * @brief Times each step of a one-shot invocation, from `hid_init` to `hid_exit`, in process.
+ *
+ * Every iteration goes through the whole sequence, so that each step runs against fresh hidapi
+ * state, as it would in a new process.
+ *
+ * @param display[in] The display, whose layout sizes the brightness feature report.
+ * @param options[in] The benchmark parameters.
+ */
+static bool bench_phases(const struct display* display, const struct bench_options* options) {
+  enum { INIT, ENUMERATE, SCAN, OPEN, DESCRIPTOR, GET, CLOSE, EXIT, PHASES };
+  static const char* names[PHASES] = {
+      "hid_init",   "hid_enumerate",  "scan_displays", "hid_open_path", "report_descriptor",
+      "get_feature_report", "hid_close", "hid_exit",
+  };
+
+  struct bench_series series[PHASES];
+  size_t initialized = 0;
+  while (initialized < PHASES &&
+         bench_series_init(&series[initialized], "phases", names[initialized],
+                           options->iterations)) {
+    ++initialized;
+  }
+
+  for (unsigned int i = 0; initialized == PHASES && i < options->iterations; ++i) {
+    uint64_t start_ns = monotonic_ns();
+    if (!bench_series_record(&series[INIT], start_ns, hid_init() == 0)) {
+      continue;
+    }
+
+    start_ns = monotonic_ns();
+    struct hid_device_info* devices = hid_enumerate(0x0, 0x0);
+    hid_free_enumeration(devices);
+    bench_series_record(&series[ENUMERATE], start_ns, devices != NULL);
+
+    struct display displays[MAX_DISPLAYS];
+    start_ns = monotonic_ns();
+    size_t count = scan_displays(displays, MAX_DISPLAYS);
+    bench_series_record(&series[SCAN], start_ns, count > 0);
+    close_displays(displays, count);
+
+    start_ns = monotonic_ns();
+    hid_device* device = hid_open_path(display->path);
+    if (bench_series_record(&series[OPEN], start_ns, device != NULL)) {
+      unsigned char descriptor[HID_MAX_DESCRIPTOR_SIZE];
+      start_ns = monotonic_ns();
+      bench_series_record(&series[DESCRIPTOR], start_ns,
+                          hid_get_report_descriptor(device, descriptor, sizeof(descriptor)) > 0);
+
+      // The brightness feature report, as described by the report descriptor of the display.
+      unsigned char report[UINT8_MAX] = {display->layout.report_id};
+      start_ns = monotonic_ns();
+      bench_series_record(
+          &series[GET], start_ns,
+          hid_get_feature_report(device, report, display->layout.feature_length) > 0);
+
+      start_ns = monotonic_ns();
+      hid_close(device);
+      bench_series_record(&series[CLOSE], start_ns, true);
+    }
+
+    start_ns = monotonic_ns();
+    bench_series_record(&series[EXIT], start_ns, hid_exit() == 0);
+  }
+
+  bool success = initialized == PHASES;
+  for (size_t i = 0; i < initialized; ++i) {
+    if (success) {
+      bench_series_report(&series[i], options->json);
+    } else {
+      free(series[i].samples_ns);
+    }
+  }
+  return success;
+}
+
+/**
+ * @brief Times feature reports sent back to back on a handle that stays open.
+ *
+ * The brightness is set to its current value, so that running the benchmark is not visible.
+ */
+static bool bench_warm(const char* path, const struct bench_options* options) {
+  struct bench_series get, set;
+  if (!bench_series_init(&get, "warm", "get_feature_report", options->iterations)) {
+    return false;
+  }
+  if (!bench_series_init(&set, "warm", "send_feature_report", options->iterations)) {
+    free(get.samples_ns);
+    return false;
+  }
+
+  struct device* device = open_device(path);
+  int32_t brightness = device ? hid_get_brightness(device) : -1;
+
+  for (unsigned int i = 0; brightness >= 0 && i < options->iterations; ++i) {
+    uint64_t start_ns = monotonic_ns();
+    int32_t current = hid_get_brightness(device);
+    if (bench_series_record(&get, start_ns, current >= 0)) {
+      brightness = current;
+    }
+
+    start_ns = monotonic_ns();
+    bench_series_record(&set, start_ns, hid_set_brightness(device, brightness));
+  }
+
+  if (device) {
+    close_device(device);
+  }
+  if (brightness < 0) {
+    fprintf(stderr, "error: failed to read brightness from device: %s\n", path);
+    free(get.samples_ns);
+    free(set.samples_ns);
+    return false;
+  }
+
+  bench_series_report(&get, options->json);
+  bench_series_report(&set, options->json);
+  return true;
+}
+
+/**
+ * @brief Times complete `get` invocations of this program, from spawn to exit.
+ *
+ * The child inherits the display selection and the device cache, as a script calling the program
+ * repeatedly would. Its standard output is discarded.
+ */
+static bool bench_cold(const struct display_selector* selector,
+                       const struct bench_options* options) {
+  char index[16];
+  char* argv[6];
+  int argc = 0;
+
+  argv[argc++] = PROJECT_NAME;
+  if (selector->serial) {
+    argv[argc++] = "--serial";
+    argv[argc++] = (char*)selector->serial;
+  } else if (selector->index >= 0) {
+    snprintf(index, sizeof(index), "%d", selector->index);
+    argv[argc++] = "--index";
+    argv[argc++] = index;
+  }
+  argv[argc++] = "get";
+  argv[argc] = NULL;
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+  struct bench_series series;
+  if (!bench_series_init(&series, "cold", "process_get", options->iterations)) {
+    posix_spawn_file_actions_destroy(&actions);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < options->iterations; ++i) {
+    uint64_t start_ns = monotonic_ns();
+    pid_t pid;
+    int status = -1;
+#if defined(BENCH_SELF_EXECUTABLE)
+    int error = posix_spawn(&pid, BENCH_SELF_EXECUTABLE, &actions, NULL, argv, environ);
+#else
+    int error = posix_spawnp(&pid, options->program, &actions, NULL, argv, environ);
+#endif
+    if (!error) {
+      waitpid(pid, &status, 0);
+    }
+    bench_series_record(&series, start_ns, WIFEXITED(status) && WEXITSTATUS(status) == SUCCESS);
+  }
+
+  posix_spawn_file_actions_destroy(&actions);
+  bench_series_report(&series, options->json);
+  return true;
+}
+
+#if defined(__linux__)
+/**
+ * @brief Times `get` requests served by a running `apdbctld`.
+ *
+ * Measures both a connection per request, as `apdbctl-client` does, and requests pipelined over a
+ * single connection.
+ */
+static bool bench_daemon(const struct bench_options* options) {
+  const struct daemon_request request = {.command = DAEMON_COMMAND_GET};
+  struct daemon_response response;
+
+  int fd = daemon_connect();
+  if (fd < 0) {
+    fprintf(stderr, "error: no daemon running, skipping daemon benchmark.\n");
+    return false;
+  }
+
+  struct bench_series connected, round_trip;
+  if (!bench_series_init(&connected, "daemon", "connect_get", options->iterations)) {
+    close(fd);
+    return false;
+  }
+  if (!bench_series_init(&round_trip, "daemon", "get", options->iterations)) {
+    free(connected.samples_ns);
+    close(fd);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < options->iterations; ++i) {
+    uint64_t start_ns = monotonic_ns();
+    int connection = daemon_connect();
+    bool success = connection >= 0 && daemon_call(connection, &request, &response) &&
+                   response.status == SUCCESS;
+    if (connection >= 0) {
+      close(connection);
+    }
+    bench_series_record(&connected, start_ns, success);
+
+    start_ns = monotonic_ns();
+    success = daemon_call(fd, &request, &response) && response.status == SUCCESS;
+    bench_series_record(&round_trip, start_ns, success);
+  }
+
+  close(fd);
+  bench_series_report(&connected, options->json);
+  bench_series_report(&round_trip, options->json);
+  return true;
+}
+
+/**
+ * @brief Removes a runtime directory created by `bench_spawn`, and the files daemons left in it.
+ */
+static void remove_runtime_directory(const char* directory) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", directory, RUNTIME_DIRECTORY);
+  DIR* entries = opendir(path);
+  if (entries) {
+    for (struct dirent* entry = readdir(entries); entry; entry = readdir(entries)) {
+      unlinkat(dirfd(entries), entry->d_name, 0);
+    }
+    closedir(entries);
+  }
+  rmdir(path);
+  rmdir(directory);
+}
+
+/**
+ * @brief Times starts of `apdbctld` on demand, as `apdbctl-client` performs them.
+ *
+ * Each iteration starts a daemon in a private runtime directory, so that a daemon already running
+ * is left alone, and times how long until its socket accepts connections, then its first `get`,
+ * which waits for the display to be opened. The daemon is then terminated.
+ */
+static bool bench_spawn(const struct bench_options* options) {
+  const struct daemon_request request = {.command = DAEMON_COMMAND_GET};
+  struct daemon_response response;
+
+  char directory[] = "/tmp/apdbctl-bench-XXXXXX";
+  if (!mkdtemp(directory)) {
+    fprintf(stderr, "error: failed to create runtime directory: %s\n", strerror(errno));
+    return false;
+  }
+  const char* runtime_directory = getenv("XDG_RUNTIME_DIR");
+  char* saved_runtime_directory = runtime_directory ? strdup(runtime_directory) : NULL;
+  setenv("XDG_RUNTIME_DIR", directory, /* overwrite= */ 1);
+
+  struct bench_series spawned, first;
+  bool success = bench_series_init(&spawned, "spawn", "spawn_connect", options->iterations);
+  if (success && !bench_series_init(&first, "spawn", "first_get", options->iterations)) {
+    free(spawned.samples_ns);
+    success = false;
+  }
+
+  for (unsigned int i = 0; success && i < options->iterations; ++i) {
+    uint64_t start_ns = monotonic_ns();
+    pid_t pid;
+    int fd = daemon_connect_or_spawn(BENCH_IDLE_TIMEOUT, &pid);
+    if (bench_series_record(&spawned, start_ns, fd >= 0 && pid > 0)) {
+      start_ns = monotonic_ns();
+      bench_series_record(&first, start_ns,
+                          daemon_call(fd, &request, &response) && response.status == SUCCESS);
+    }
+
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (pid > 0) {
+      kill(pid, SIGTERM);
+      waitpid(pid, NULL, 0);
+    }
+  }
+
+  if (saved_runtime_directory) {
+    setenv("XDG_RUNTIME_DIR", saved_runtime_directory, /* overwrite= */ 1);
+    free(saved_runtime_directory);
+  } else {
+    unsetenv("XDG_RUNTIME_DIR");
+  }
+  remove_runtime_directory(directory);
+
+  if (!success) {
+    return false;
+  }
+  if (!spawned.count) {
+    fprintf(stderr, "error: failed to start %sd, is it in PATH?\n", PROJECT_NAME);
+  }
+  bench_series_report(&spawned, options->json);
+  bench_series_report(&first, options->json);
+  return spawned.count > 0;
+}
+#endif
+
+/**
+ * @brief Measures the latency of each step of reading and writing the brightness.
+ *
+ * Each mode runs `options->iterations` times and reports the p50, p90, p99 and maximum latency of
+ * its operations, along with their throughput:
+ * - `phases`: each hidapi call of a one-shot invocation, in process;
+ * - `warm`: feature reports on a handle kept open;
+ * - `cold`: complete `get` invocations, each in a new process;
+ * - `daemon`: `get` requests to a running `apdbctld`, on Linux;
+ * - `spawn`: starts of `apdbctld` on demand and their first `get`, on Linux.
+ *
+ * @param selector[in] The display to operate on. Must select a single display.
+ * @param options[in] The benchmark parameters.
+ *
+ * @retval SUCCESS All selected modes ran.
+ * @retval ERR_DEVICE_NOT_FOUND Apple Pro Display XDR brightness control device not found.
+ * @retval ERR_INVALID_PRECONDITION A mode could not run, e.g. without a daemon.
+ */
+int run_bench(const struct display_selector* selector, const struct bench_options* options) {
+  struct display display;
+  if (!open_displays(selector, &display, 1)) {
+    fprintf(stderr, "error: Apple Pro Display XDR brightness control device not found.\n");
+    return ERR_DEVICE_NOT_FOUND;
+  }
+  close_displays(&display, 1);
+
+  bool success = true;
+  bench_print_header(options->json);
+
+  if (options->modes & BENCH_MODE_PHASES) {
+    success &= bench_phases(&display, options);
+  }
+  if (options->modes & BENCH_MODE_WARM) {
+    success &= bench_warm(display.path, options);
+  }
+  if (options->modes & BENCH_MODE_COLD) {
+    success &= bench_cold(selector, options);
+  }
+  if (options->modes & BENCH_MODE_DAEMON) {
+#if defined(__linux__)
+    success &= bench_daemon(options);
+#else
+    fprintf(stderr, "error: the daemon is not supported on this platform.\n");
+    success = false;
+#endif
+  }
+  if (options->modes & BENCH_MODE_SPAWN) {
+#if defined(__linux__)
+    success &= bench_spawn(options);
+#else
+    fprintf(stderr, "error: the daemon is not supported on this platform.\n");
+    success = false;
+#endif
+  }
+
+  return success ? SUCCESS : ERR_INVALID_PRECONDITION;
+}
@@ -0,0 +1,34 @@
+#ifndef APDBCTL_BENCH_H
+#define APDBCTL_BENCH_H
+
+#include <stdbool.h>
+
+#include "device.h"
+
+#define BENCH_MODE_PHASES 0x1
+#define BENCH_MODE_WARM 0x2
+#define BENCH_MODE_COLD 0x4
+#define BENCH_MODE_DAEMON 0x8
+#define BENCH_MODE_SPAWN 0x10
+#define BENCH_MODE_ALL \
+  (BENCH_MODE_PHASES | BENCH_MODE_WARM | BENCH_MODE_COLD | BENCH_MODE_DAEMON | BENCH_MODE_SPAWN)
+
+/**
+ * @brief Benchmark parameters.
+ *
+ * @param iterations The number of iterations of each measurement.
+ * @param modes A combination of `BENCH_MODE_*`.
+ * @param json Whether to print JSON objects rather than a table.
+ * @param program The path of this program, spawned by the cold-process mode.
+ */
+struct bench_options {
+  unsigned int iterations;
+  unsigned int modes;
+  bool json;
+  const char* program;
+};
+
+bool parse_bench_mode(const char* parameter, unsigned int* mode);
+int run_bench(const struct display_selector* selector, const struct bench_options* options);
+
+#endif  // APDBCTL_BENCH_H
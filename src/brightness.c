@@ -0,0 +1,124 @@
+#include "brightness.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Converts an absolute brightness value into a percentage one.
+ *
+ * Parameter must be a valid absolute value (i.e. in [BRIGHTNESS_MIN, BRIGHTNESS_MAX]).
+ * Floating-point values are truncated toward zero.
+ *
+ * @param absolute[in] The absolute value to convert to percentage.
+ * @return The percentage brightness value (in [0, 100]).
+ */
+uint8_t to_percent_brightness(uint32_t absolute) {
+  assert(absolute >= BRIGHTNESS_MIN && absolute <= BRIGHTNESS_MAX);
+
+  uint8_t percentage = (uint8_t)((absolute - BRIGHTNESS_MIN) / (float)BRIGHTNESS_RANGE * 100);
+  assert(percentage >= 0 && percentage <= 100);
+
+  return percentage;
+}
+
+/**
+ * @brief Converts a percentage brightness value into an absolute one.
+ *
+ * Parameter must be a valid percentage value (i.e. in [0, 100]).
+ * Floating-point values are truncated toward zero.
+ *
+ * @param percentage[in] The percentage value to convert to absolute.
+ * @return The absolute brightness value (in [BRIGHTNESS_MIN, BRIGHTNESS_MAX]).
+ */
+uint32_t to_absolute_brightness(uint8_t percentage) {
+  assert(percentage >= 0 && percentage <= 100);
+
+  uint32_t absolute = (percentage * BRIGHTNESS_RANGE / 100) + BRIGHTNESS_MIN;
+  assert(absolute >= BRIGHTNESS_MIN && absolute <= BRIGHTNESS_MAX);
+
+  return absolute;
+}
+
+/**
+ * @brief Parses the input string as a brightness value.
+ *
+ * Brightness value can be either absolute (an integer in [400, 50000]) or percentage ("50%").
+ *
+ * @param parameter[in] The string to parse.
+ * @param value[out] The output value, if successful.
+ * @param as_percentage_point[out] Whether `value` is absolute or percentage.
+ *
+ * @retval true Parsing successful.
+ * @retval false Malformed absolute or percentage brightness value.
+ */
+bool parse_brightness_parameter(const char* parameter, uint32_t* value, bool* as_percentage_point) {
+  char* last = NULL;
+
+  errno = 0;
+  unsigned long parsed = strtoul(parameter, &last, /* base= */ 10);
+
+  if (parsed == ULONG_MAX && errno) {
+    return false;
+  }
+
+  // No digits found.
+  if (parameter == last) return false;
+
+  if (*last == '%' && *(last + 1) == '\0' && parsed <= 100) {
+    *value = parsed;
+    *as_percentage_point = true;
+    return true;
+  }
+
+  if (*last == '\0' && parsed >= BRIGHTNESS_MIN && parsed <= BRIGHTNESS_MAX) {
+    *value = parsed;
+    *as_percentage_point = false;
+    return true;
+  }
+
+  // Any other trailing character.
+  return false;
+}
+
+/**
+ * @brief Parses the input string as a duration.
+ *
+ * Durations are a non-negative decimal number followed by a unit: `us`, `ms` or `s` (e.g. "250ms",
+ * "1.5s").
+ *
+ * @param parameter[in] The string to parse.
+ * @param nanoseconds[out] The parsed duration in nanoseconds, if successful.
+ *
+ * @retval true Parsing successful.
+ * @retval false Malformed duration, or unknown unit.
+ */
+bool parse_duration(const char* parameter, uint64_t* nanoseconds) {
+  char* last = NULL;
+
+  errno = 0;
+  double parsed = strtod(parameter, &last);
+
+  // No digits found, or out of range.
+  if (parameter == last || errno || !(parsed >= 0)) return false;
+
+  double scale;
+  if (!strcmp(last, "us")) {
+    scale = 1e3;
+  } else if (!strcmp(last, "ms")) {
+    scale = 1e6;
+  } else if (!strcmp(last, "s")) {
+    scale = 1e9;
+  } else {
+    return false;
+  }
+
+  if (parsed * scale >= (double)UINT64_MAX) {
+    return false;
+  }
+
+  *nanoseconds = (uint64_t)(parsed * scale);
+  return true;
+}
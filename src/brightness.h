@@ -0,0 +1,26 @@
+#ifndef APDBCTL_BRIGHTNESS_H
+#define APDBCTL_BRIGHTNESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BRIGHTNESS_MIN 0x0190  // 400
+#define BRIGHTNESS_MAX 0xc350  // 50_000
+#define BRIGHTNESS_RANGE (BRIGHTNESS_MAX - BRIGHTNESS_MIN)
+
+#if BRIGHTNESS_MIN >= BRIGHTNESS_MAX
+#error "BRIGHTNESS_MIN must be strictly less than BRIGHTNESS_MAX"
+#endif
+
+#define SUCCESS 0
+#define ERR_INVALID_ARGUMENT 1
+#define ERR_DEVICE_NOT_FOUND 2
+#define ERR_HIDAPI_CALL_FAIL 3
+#define ERR_INVALID_PRECONDITION 4
+
+uint8_t to_percent_brightness(uint32_t absolute);
+uint32_t to_absolute_brightness(uint8_t percentage);
+bool parse_brightness_parameter(const char* parameter, uint32_t* value, bool* as_percentage_point);
+bool parse_duration(const char* parameter, uint64_t* nanoseconds);
+
+#endif  // APDBCTL_BRIGHTNESS_H
@@ -0,0 +1,170 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "brightness.h"
+#include "protocol.h"
+
+#define FALLBACK_PROGRAM PROJECT_NAME
+#define DEFAULT_IDLE_TIMEOUT "300s"
+
+/**
+ * @brief Replaces the current process with the full `apdbctl` program.
+ *
+ * Used when no daemon is running, or for commands the client does not handle itself, so that the
+ * client is a drop-in replacement for `apdbctl`.
+ *
+ * @param argc[in] The number of arguments.
+ * @param argv[in] The arguments, as received by `main`.
+ * @return Only returns on failure, with `ERR_INVALID_PRECONDITION`.
+ */
+static int exec_fallback(int argc, char* argv[]) {
+  char* fallback_argv[argc + 1];
+  fallback_argv[0] = FALLBACK_PROGRAM;
+  for (int i = 1; i <= argc; ++i) {
+    fallback_argv[i] = argv[i];
+  }
+
+  execvp(FALLBACK_PROGRAM, fallback_argv);
+  fprintf(stderr, "error: failed to execute %s: %s\n", FALLBACK_PROGRAM, strerror(errno));
+  return ERR_INVALID_PRECONDITION;
+}
+
+/**
+ * @brief Parses the command line into a daemon request.
+ *
+ * Only recognizes the exact `get [-% | -p | --percent]`, `set <value> [--force]` and `stats` forms.
+ * Everything else (help, invalid parameters…) is left to the full program.
+ *
+ * @param argc[in] The number of arguments.
+ * @param argv[in] The arguments, as received by `main`.
+ * @param request[out] The request to send to the daemon.
+ * @param as_percentage_point[out] Whether to print the result of `get` as a percentage.
+ *
+ * @retval true The command line maps to a daemon request.
+ * @retval false The command line must be handled by the full program.
+ */
+static bool parse_request(int argc, char* argv[], struct daemon_request* request,
+                          bool* as_percentage_point) {
+  *request = (struct daemon_request){0};
+  *as_percentage_point = false;
+
+  // <program> get [-%]
+  if (argc >= 2 && argc <= 3 && !strcmp(argv[1], "get")) {
+    if (argc == 3 && strcmp(argv[2], "-%") && strcmp(argv[2], "-p") &&
+        strcmp(argv[2], "--percent")) {
+      return false;
+    }
+    request->command = DAEMON_COMMAND_GET;
+    *as_percentage_point = argc == 3;
+    return true;
+  }
+
+  // <program> stats
+  if (argc == 2 && !strcmp(argv[1], "stats")) {
+    request->command = DAEMON_COMMAND_STATS;
+    return true;
+  }
+
+  // <program> set <value> [--force]
+  if ((argc == 3 || (argc == 4 && !strcmp(argv[3], "--force"))) && !strcmp(argv[1], "set")) {
+    bool percent;
+    if (!parse_brightness_parameter(argv[2], &request->value, &percent)) {
+      return false;
+    }
+    request->command = DAEMON_COMMAND_SET;
+    request->flags = (percent ? DAEMON_FLAG_PERCENT : 0) | (argc == 4 ? DAEMON_FLAG_FORCE : 0);
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * @brief Connects to the daemon, starting it on demand.
+ *
+ * A daemon started by the client exits after `APDBCTL_DAEMON_IDLE_TIMEOUT` without requests (5
+ * minutes by default), so that it only holds the display while brightness is being changed.
+ * Setting `APDBCTL_DAEMON_SPAWN=0` only connects to a daemon started otherwise, e.g. by systemd.
+ *
+ * @return The connected socket, or -1 if no daemon is running and none could be started.
+ */
+static int connect_daemon(void) {
+  const char* spawn = getenv("APDBCTL_DAEMON_SPAWN");
+  if (spawn && !strcmp(spawn, "0")) {
+    return daemon_connect();
+  }
+
+  const char* idle_timeout = getenv("APDBCTL_DAEMON_IDLE_TIMEOUT");
+  uint64_t idle_timeout_ns;
+  if (!idle_timeout) {
+    idle_timeout = DEFAULT_IDLE_TIMEOUT;
+  } else if (!parse_duration(idle_timeout, &idle_timeout_ns)) {
+    fprintf(stderr, "warning: invalid APDBCTL_DAEMON_IDLE_TIMEOUT '%s', not starting daemon.\n",
+            idle_timeout);
+    return daemon_connect();
+  }
+
+  pid_t pid;
+  return daemon_connect_or_spawn(idle_timeout, &pid);
+}
+
+int main(int argc, char* argv[]) {
+  struct daemon_request request;
+  bool as_percentage_point;
+
+  if (!parse_request(argc, argv, &request, &as_percentage_point)) {
+    return exec_fallback(argc, argv);
+  }
+
+  // Counters are only meaningful for a daemon that is already running.
+  int fd = request.command == DAEMON_COMMAND_STATS ? daemon_connect() : connect_daemon();
+  if (fd < 0 && request.command == DAEMON_COMMAND_STATS) {
+    fprintf(stderr, "error: no daemon running.\n");
+    return ERR_INVALID_PRECONDITION;
+  }
+  if (fd < 0) {
+    return exec_fallback(argc, argv);
+  }
+
+  // Counters of the daemon, as key=value lines.
+  if (request.command == DAEMON_COMMAND_STATS) {
+    char statistics[DAEMON_STATISTICS_SIZE + 1];
+    bool success = daemon_call_statistics(fd, statistics, sizeof(statistics));
+    close(fd);
+    if (!success) {
+      fprintf(stderr, "error: failed to retrieve daemon counters.\n");
+      return ERR_INVALID_PRECONDITION;
+    }
+    fputs(statistics, stdout);
+    return SUCCESS;
+  }
+
+  struct daemon_response response;
+  bool success = daemon_call(fd, &request, &response);
+  close(fd);
+
+  if (!success) {
+    return exec_fallback(argc, argv);
+  }
+
+  if (response.status == ERR_DEVICE_NOT_FOUND) {
+    fprintf(stderr, "error: Apple Pro Display XDR brightness control device not found.\n");
+  } else if (response.status == ERR_INVALID_PRECONDITION) {
+    fprintf(stderr, "error: displays busy, too many invocations waiting.\n");
+  } else if (response.status != SUCCESS) {
+    fprintf(stderr, "error: daemon request failed with status %d.\n", response.status);
+  } else if (request.command == DAEMON_COMMAND_GET) {
+    if (as_percentage_point) {
+      printf("%u%%\n", to_percent_brightness(response.brightness));
+    } else {
+      printf("%u\n", response.brightness);
+    }
+  }
+
+  return response.status;
+}
@@ -0,0 +1,55 @@
+#include "clock.h"
+
+#include <errno.h>
+#include <time.h>
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return The current time of the monotonic clock, in nanoseconds.
+ */
+uint64_t monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+/**
+ * @brief Reads the wall clock.
+ *
+ * @return The current time, in nanoseconds since the Unix epoch.
+ */
+uint64_t realtime_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+/**
+ * @brief Sleeps until an absolute deadline of the monotonic clock.
+ *
+ * Sleeping until an absolute deadline, rather than for a relative duration, prevents the wake-up
+ * latency of successive sleeps from accumulating. Returns immediately if the deadline has passed.
+ *
+ * @param deadline_ns[in] The time to wake up at, in nanoseconds of the monotonic clock.
+ */
+void sleep_until(uint64_t deadline_ns) {
+#if defined(__APPLE__)
+  // No clock_nanosleep: approximate with relative sleeps.
+  for (uint64_t now = monotonic_ns(); now < deadline_ns; now = monotonic_ns()) {
+    uint64_t remaining = deadline_ns - now;
+    struct timespec duration = {
+        .tv_sec = remaining / NANOSECONDS_PER_SECOND,
+        .tv_nsec = remaining % NANOSECONDS_PER_SECOND,
+    };
+    nanosleep(&duration, NULL);
+  }
+#else
+  struct timespec deadline = {
+      .tv_sec = deadline_ns / NANOSECONDS_PER_SECOND,
+      .tv_nsec = deadline_ns % NANOSECONDS_PER_SECOND,
+  };
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+  }
+#endif
+}
@@ -0,0 +1,12 @@
+#ifndef APDBCTL_CLOCK_H
+#define APDBCTL_CLOCK_H
+
+#include <stdint.h>
+
+#define NANOSECONDS_PER_SECOND 1000000000ull
+
+uint64_t monotonic_ns(void);
+uint64_t realtime_ns(void);
+void sleep_until(uint64_t deadline_ns);
+
+#endif  // APDBCTL_CLOCK_H
@@ -0,0 +1,731 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <hidapi.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "brightness.h"
+#include "clock.h"
+#include "device.h"
+#include "hotplug.h"
+#include "lock.h"
+#include "protocol.h"
+#include "stats.h"
+#include "status.h"
+
+#define MAX_CLIENTS 64
+#define MAX_REQUESTS_PER_CLIENT 16
+#define MAX_PENDING_REQUESTS (MAX_CLIENTS * MAX_REQUESTS_PER_CLIENT)
+
+// The listening socket, the hotplug monitor and the input reports come first in the polled
+// descriptors.
+#define FIRST_CLIENT 3
+
+static volatile sig_atomic_t terminate = 0;
+
+/**
+ * @brief Signal handler requesting the daemon to shut down.
+ *
+ * @param signal[in] The received signal.
+ */
+static void on_terminate(int signal) {
+  (void)signal;
+  terminate = 1;
+}
+
+/**
+ * @brief Prints usage on standard error.
+ *
+ * @param program_name[in] The name of the program, typically `argv[0]`.
+ */
+static void print_usage(const char* program_name) {
+  // clang-format off
+  fprintf(stderr, "%sd v%s, revision %s, distributed by: %s\n", PROJECT_NAME, VERSION, GIT_REVISION, DISTRIBUTOR);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Usage: %s [--idle-timeout <duration>]\n", program_name);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Keeps the Apple Pro Display XDR brightness control device open and serves get/set\n");
+  fprintf(stderr, "requests on $XDG_RUNTIME_DIR/apdbctl/%s.\n", DAEMON_SOCKET_NAME);
+  fprintf(stderr, "The brightness is also published in $XDG_RUNTIME_DIR/apdbctl/%s, read by\n", STATUS_PAGE_NAME);
+  fprintf(stderr, "'apdbctl get --cached' without any request.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Counters are printed at exit, and served to 'apdbctl-client stats'.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --idle-timeout <duration>  Exit after duration without requests (default: never)\n");
+  fprintf(stderr, "                             Used by 'apdbctl-client' when it starts the daemon\n");
+  // clang-format on
+}
+
+/**
+ * @brief Counters of the requests served by the daemon.
+ *
+ * @param set_requests The number of valid set requests received.
+ * @param writes_sent The number of set requests the device accepted.
+ * @param writes_failed The number of set requests that failed, e.g. without a display.
+ * @param writes_elided The number of set requests superseded by a more recent one before they were
+ *   executed.
+ * @param writes_unchanged The number of set requests not sent, the display having the brightness
+ *   already.
+ */
+struct daemon_statistics {
+  uint64_t set_requests;
+  uint64_t writes_sent;
+  uint64_t writes_failed;
+  uint64_t writes_elided;
+  uint64_t writes_unchanged;
+};
+
+/**
+ * @brief The state of the daemon.
+ *
+ * @param display The display, whose device is NULL if it is not currently open.
+ * @param hotplug_fd The hotplug monitor, or -1 if unavailable.
+ * @param absent Whether the hotplug monitor reported the display gone: it is not looked up again
+ *   until a node is added.
+ * @param input_fd The input reports of the display, or -1 if unavailable.
+ * @param shadow The last brightness the display confirmed, by a read-back or an input report, or -1
+ *   if unknown. Discarded when a set is sent, until the display confirms it.
+ * @param status The status page published for readers, or NULL if unavailable.
+ * @param idle_timeout_ns How long to run without clients before exiting, or 0 to run until
+ *   terminated.
+ * @param spawn_lock_fd The spawn lock, held from the moment an idle daemon decides to exit, or -1.
+ * @param statistics Counters of the requests served.
+ */
+struct daemon {
+  struct display display;
+  int hotplug_fd;
+  bool absent;
+  int input_fd;
+  int32_t shadow;
+  struct status_page* status;
+  uint64_t idle_timeout_ns;
+  int spawn_lock_fd;
+  struct daemon_statistics statistics;
+};
+
+/**
+ * @brief A request received from a client, waiting to be processed.
+ *
+ * @param fd The socket of the client.
+ * @param request The request.
+ */
+struct pending_request {
+  int fd;
+  struct daemon_request request;
+};
+
+/**
+ * @brief Starts following the brightness of a display that was just opened.
+ *
+ * Publishes its current brightness, then listens to the input reports it sends on changes, so that
+ * the status page stays current however the brightness is changed.
+ *
+ * @param daemon[in,out] The daemon state.
+ */
+static void daemon_opened(struct daemon* daemon) {
+  daemon->input_fd = open_input_reports(&daemon->display);
+  daemon->shadow = hid_get_brightness(daemon->display.device);
+  status_page_publish(daemon->status, STATUS_CONNECTED, daemon->shadow);
+}
+
+/**
+ * @brief Returns the brightness control device, opening it if needed.
+ *
+ * @param daemon[in,out] The daemon state.
+ * @return The HID device, or NULL if it could not be found.
+ */
+static struct device* daemon_device(struct daemon* daemon) {
+  struct display_selector selector = {.index = -1};
+  if (daemon->display.device || daemon->absent) {
+    return daemon->display.device;
+  }
+
+  if (open_displays(&selector, &daemon->display, 1)) {
+    daemon_opened(daemon);
+  } else {
+    // Wait for the display to be connected, rather than scanning again on every request.
+    daemon->display.device = NULL;
+    daemon->absent = daemon->hotplug_fd >= 0;
+  }
+  return daemon->display.device;
+}
+
+/**
+ * @brief Closes the brightness control device, e.g. after it went stale.
+ *
+ * @param daemon[in,out] The daemon state.
+ */
+static void daemon_close_device(struct daemon* daemon) {
+  if (daemon->input_fd >= 0) {
+    close(daemon->input_fd);
+    daemon->input_fd = -1;
+  }
+  daemon->shadow = -1;
+  close_displays(&daemon->display, 1);
+  status_page_publish(daemon->status, STATUS_DISCONNECTED, -1);
+}
+
+/**
+ * @brief Publishes the brightness carried by the input reports received from the display.
+ *
+ * Reads them from `input_fd` if open, or else from the device itself, where any backend queues
+ * them.
+ *
+ * @param daemon[in,out] The daemon state.
+ */
+static void daemon_input(struct daemon* daemon) {
+  int32_t brightness = daemon->input_fd >= 0
+                           ? read_input_brightness(daemon->input_fd, &daemon->display.layout)
+                           : drain_input_brightness(daemon->display.device);
+  if (brightness >= 0) {
+    daemon->shadow = brightness;
+    status_page_publish(daemon->status, STATUS_CONNECTED, brightness);
+  } else if (brightness != BRIGHTNESS_TIMED_OUT) {
+    // The display is presumably gone: the next request or hotplug event closes its device.
+    if (daemon->input_fd >= 0) {
+      close(daemon->input_fd);
+      daemon->input_fd = -1;
+    }
+    daemon->shadow = -1;
+  }
+}
+
+/**
+ * @brief Follows the display as it is disconnected and reconnected.
+ *
+ * The device is closed as soon as its node is removed, and the first brightness control node added
+ * afterwards is opened right away, so that requests neither fail on a stale handle nor wait for a
+ * scan.
+ *
+ * @param daemon[in,out] The daemon state.
+ */
+static void daemon_hotplug(struct daemon* daemon) {
+  struct display_selector selector = {.index = -1};
+  struct hotplug_event event;
+  bool changed = false;
+  int received;
+
+  while ((received = hotplug_receive(daemon->hotplug_fd, &event)) > 0) {
+    changed = true;
+    if (event.action == HOTPLUG_REMOVE && daemon->display.device &&
+        !strcmp(event.node, daemon->display.path)) {
+      fprintf(stderr, "hotplug: display removed from %s\n", event.node);
+      daemon_close_device(daemon);
+      daemon->absent = true;
+    } else if (event.action == HOTPLUG_ADD && !daemon->display.device &&
+               open_added_display(event.node, &selector, &daemon->display)) {
+      fprintf(stderr, "hotplug: display added at %s\n", event.node);
+      daemon->absent = false;
+      daemon_opened(daemon);
+    }
+  }
+
+  if (received < 0) {
+    // Events were lost: the display may have come back unnoticed.
+    fprintf(stderr, "warning: hotplug events lost, scanning displays.\n");
+    daemon->absent = false;
+    daemon_device(daemon);
+  }
+
+  if ((changed || received < 0) && daemon->display.device) {
+    // Input reports may have been missed while devices came and went: read the brightness back.
+    daemon->shadow = hid_get_brightness(daemon->display.device);
+    status_page_publish(daemon->status, STATUS_CONNECTED, daemon->shadow);
+  }
+}
+
+/**
+ * @brief Returns the absolute brightness requested by a set request.
+ */
+static uint32_t daemon_requested_brightness(const struct daemon_request* request) {
+  return request->flags & DAEMON_FLAG_PERCENT ? to_absolute_brightness(request->value)
+                                              : request->value;
+}
+
+/**
+ * @brief Checks whether a set request would leave the brightness of the display unchanged.
+ *
+ * Automation commonly applies the brightness the display already has (e.g. on every workspace
+ * switch). Such sets are answered without a feature report, unless forced. Only a brightness the
+ * display confirmed is trusted: after a set, the display confirms it with an input report.
+ *
+ * @param daemon[in,out] The daemon state.
+ * @param request[in] The set request.
+ * @return Whether the display is known to have the requested brightness already.
+ */
+static bool daemon_is_unchanged(struct daemon* daemon, const struct daemon_request* request) {
+  if ((request->flags & DAEMON_FLAG_FORCE) || !daemon->display.device) {
+    return false;
+  }
+  // Catch up with the changes reported since the last poll, e.g. by another program.
+  daemon_input(daemon);
+  return daemon->shadow >= 0 && daemon->shadow == (int32_t)daemon_requested_brightness(request);
+}
+
+/**
+ * @brief Executes a single request against the brightness control device.
+ *
+ * @param daemon[in,out] The daemon state.
+ * @param request[in] The request to execute.
+ * @param response[out] The response to the request.
+ *
+ * @retval true The request was executed, successfully or not, and `response` is final.
+ * @retval false A HID call failed, the device handle is presumably stale.
+ */
+static bool daemon_execute(struct daemon* daemon, const struct daemon_request* request,
+                           struct daemon_response* response) {
+  struct device* device = daemon_device(daemon);
+  if (!device) {
+    response->status = ERR_DEVICE_NOT_FOUND;
+    return true;
+  }
+
+  if (request->command == DAEMON_COMMAND_SET) {
+    uint32_t brightness = daemon_requested_brightness(request);
+    // Whether the display applies the set is only known from its next input report or read-back.
+    daemon->shadow = -1;
+    if (!hid_set_brightness(device, brightness)) {
+      return false;
+    }
+    status_page_publish(daemon->status, STATUS_CONNECTED, brightness);
+    response->status = SUCCESS;
+    response->brightness = brightness;
+    return true;
+  }
+
+  int32_t brightness = hid_get_brightness(device);
+  if (brightness < 0) {
+    return false;
+  }
+  daemon->shadow = brightness;
+  status_page_publish(daemon->status, STATUS_CONNECTED, brightness);
+  response->status = SUCCESS;
+  response->brightness = brightness;
+  return true;
+}
+
+/**
+ * @brief Checks whether a request received from a client is well-formed.
+ *
+ * @param request[in] The request to check.
+ * @return Whether the request is a get, a stats, or a set with a valid brightness value.
+ */
+static bool daemon_is_valid(const struct daemon_request* request) {
+  if (request->command == DAEMON_COMMAND_GET || request->command == DAEMON_COMMAND_STATS) {
+    return true;
+  }
+  return request->command == DAEMON_COMMAND_SET &&
+         ((request->flags & DAEMON_FLAG_PERCENT)
+              ? request->value <= 100
+              : request->value >= BRIGHTNESS_MIN && request->value <= BRIGHTNESS_MAX);
+}
+
+/**
+ * @brief Handles a valid request received from a client.
+ *
+ * If the device handle went stale (e.g. the display was power-cycled), the device is reopened
+ * transparently and the request retried once. The displays are locked meanwhile, like `apdbctl`
+ * does, so that the feature reports of other programs (e.g. a fade) do not interleave.
+ *
+ * @param daemon[in,out] The daemon state.
+ * @param request[in] The request to handle.
+ * @param response[out] The response to the request.
+ */
+static void daemon_handle(struct daemon* daemon, const struct daemon_request* request,
+                          struct daemon_response* response) {
+  *response = (struct daemon_response){0};
+
+  struct device_lock lock;
+  if (!device_lock_acquire(&lock, DEVICE_LOCK_WAIT_FOREVER)) {
+    fprintf(stderr, "warning: displays busy, too many invocations waiting.\n");
+    response->status = ERR_INVALID_PRECONDITION;
+    return;
+  }
+
+  if (!daemon_execute(daemon, request, response)) {
+    fprintf(stderr, "warning: HID call failed, reopening device.\n");
+    daemon_close_device(daemon);
+    if (!daemon_execute(daemon, request, response)) {
+      daemon_close_device(daemon);
+      response->status = ERR_HIDAPI_CALL_FAIL;
+    }
+  }
+  device_lock_release(&lock);
+}
+
+/**
+ * @brief Formats the counters of the daemon and its device I/O as `key=value` lines.
+ *
+ * @param daemon[in] The daemon state.
+ * @param buffer[out] The buffer to write to, NUL-terminated.
+ * @param size[in] The size of `buffer`.
+ * @return The length of the text written.
+ */
+static size_t format_daemon_statistics(const struct daemon* daemon, char* buffer, size_t size) {
+  int length = snprintf(buffer, size,
+                        "set_requests=%llu\nwrites_sent=%llu\nwrites_failed=%llu\n"
+                        "writes_elided=%llu\nwrites_unchanged=%llu\n",
+                        (unsigned long long)daemon->statistics.set_requests,
+                        (unsigned long long)daemon->statistics.writes_sent,
+                        (unsigned long long)daemon->statistics.writes_failed,
+                        (unsigned long long)daemon->statistics.writes_elided,
+                        (unsigned long long)daemon->statistics.writes_unchanged);
+  if (length < 0 || (size_t)length >= size) {
+    return 0;
+  }
+  return length + format_statistics(buffer + length, size - length);
+}
+
+/**
+ * @brief Processes the requests received since the device was last used.
+ *
+ * Requests accumulate in the client sockets while a feature report is in flight. Among them, only
+ * the most recent set is sent to the device: earlier sets are elided and answered with the outcome
+ * of the most recent one. Likewise, all gets are answered by a single read, issued after the set.
+ * This bounds the latency of a burst of requests (e.g. key repeat) to about two feature reports,
+ * however fast requests arrive.
+ *
+ * @param daemon[in,out] The daemon state.
+ * @param pending[in] The requests to process, in arrival order.
+ * @param count[in] The number of requests.
+ */
+static void daemon_process(struct daemon* daemon, const struct pending_request* pending,
+                           size_t count) {
+  const struct daemon_request* last_set = NULL;
+  size_t sets = 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    if (pending[i].request.command == DAEMON_COMMAND_SET && daemon_is_valid(&pending[i].request)) {
+      last_set = &pending[i].request;
+      ++sets;
+    }
+  }
+
+  struct daemon_response set_response;
+  if (last_set) {
+    daemon->statistics.set_requests += sets;
+    daemon->statistics.writes_elided += sets - 1;
+    if (daemon_is_unchanged(daemon, last_set)) {
+      set_response = (struct daemon_response){
+          .status = SUCCESS,
+          .brightness = daemon_requested_brightness(last_set),
+      };
+      daemon->statistics.writes_unchanged += 1;
+    } else {
+      daemon_handle(daemon, last_set, &set_response);
+      if (set_response.status == SUCCESS) {
+        daemon->statistics.writes_sent += 1;
+      } else {
+        daemon->statistics.writes_failed += 1;
+      }
+    }
+  }
+
+  struct daemon_response get_response;
+  bool got = false;
+
+  for (size_t i = 0; i < count; ++i) {
+    const struct daemon_request* request = &pending[i].request;
+    struct daemon_response response = {.status = ERR_INVALID_ARGUMENT};
+
+    if (request->command == DAEMON_COMMAND_STATS) {
+      char text[DAEMON_STATISTICS_SIZE];
+      size_t length = format_daemon_statistics(daemon, text, sizeof(text));
+      send(pending[i].fd, text, length, MSG_NOSIGNAL);
+      continue;
+    }
+
+    if (!daemon_is_valid(request)) {
+      // Keep the invalid argument status.
+    } else if (request->command == DAEMON_COMMAND_SET) {
+      response = set_response;
+    } else {
+      if (!got) {
+        daemon_handle(daemon, request, &get_response);
+        got = true;
+      }
+      response = get_response;
+    }
+
+    // Failures are detected on the next receive, which closes the connection.
+    send(pending[i].fd, &response, sizeof(response), MSG_NOSIGNAL);
+  }
+}
+
+/**
+ * @brief Creates the listening socket.
+ *
+ * Refuses to replace the socket of a running daemon, but removes stale sockets left behind by a
+ * daemon that did not shut down cleanly.
+ *
+ * @param path[out] The path of the socket.
+ * @param path_size[in] The size of the `path` buffer.
+ * @return The listening socket, or -1 on error.
+ */
+static int daemon_listen(char* path, size_t path_size) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (!daemon_socket_path(address.sun_path, sizeof(address.sun_path),
+                          /* create_directory= */ true)) {
+    fprintf(stderr, "error: failed to build socket path, is XDG_RUNTIME_DIR set?\n");
+    return -1;
+  }
+  snprintf(path, path_size, "%s", address.sun_path);
+
+  int running = daemon_connect();
+  if (running >= 0) {
+    close(running);
+    fprintf(stderr, "error: a daemon is already listening on %s\n", path);
+    return -1;
+  }
+  unlink(path);
+
+  // Non-blocking, so that `daemon_serve` can accept clients until none is left waiting.
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd < 0) {
+    fprintf(stderr, "error: failed to create socket: %s\n", strerror(errno));
+    return -1;
+  }
+
+  mode_t mask = umask(0177);
+  int bound = bind(fd, (struct sockaddr*)&address, sizeof(address));
+  umask(mask);
+
+  if (bound < 0 || listen(fd, SOMAXCONN) < 0) {
+    fprintf(stderr, "error: failed to listen on %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/**
+ * @brief Decides whether an idle daemon exits.
+ *
+ * Takes the spawn lock first: a client that found no socket spawns a new daemon only once this
+ * one released its socket and its status page. A client that connected before the lock was taken
+ * is served instead. One connecting between the check and the removal of the socket sees its
+ * connection reset, and falls back to the full program.
+ *
+ * @param daemon[in,out] The daemon state.
+ * @param listen_fd[in] The listening socket.
+ * @return Whether the daemon must exit, with `spawn_lock_fd` held.
+ */
+static bool daemon_retire(struct daemon* daemon, int listen_fd) {
+  daemon->spawn_lock_fd = daemon_spawn_lock();
+  struct pollfd pending = {.fd = listen_fd, .events = POLLIN};
+  if (poll(&pending, 1, 0) > 0) {
+    if (daemon->spawn_lock_fd >= 0) {
+      close(daemon->spawn_lock_fd);
+      daemon->spawn_lock_fd = -1;
+    }
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Serves requests until terminated, or idle for `idle_timeout_ns`.
+ *
+ * Each round accepts every waiting client and drains every readable one before touching the
+ * device, so that requests that arrived while the device was busy are processed together. The
+ * daemon is idle while no client is connected: clients of `apdbctl-client` only stay connected for
+ * a request.
+ *
+ * @param daemon[in,out] The daemon state.
+ * @param listen_fd[in] The listening socket.
+ * @see daemon_process
+ */
+static void daemon_serve(struct daemon* daemon, int listen_fd) {
+  static struct pending_request pending[MAX_PENDING_REQUESTS];
+  struct pollfd fds[FIRST_CLIENT + MAX_CLIENTS];
+  bool disconnected[FIRST_CLIENT + MAX_CLIENTS] = {false};
+  nfds_t nfds = FIRST_CLIENT;
+
+  fds[0] = (struct pollfd){.fd = listen_fd, .events = POLLIN};
+  // Negative descriptors are ignored by poll.
+  fds[1] = (struct pollfd){.fd = daemon->hotplug_fd, .events = POLLIN};
+  fds[2] = (struct pollfd){.events = POLLIN};
+  uint64_t active_ns = monotonic_ns();
+
+  while (!terminate) {
+    int timeout_ms = -1;
+    if (daemon->idle_timeout_ns && nfds == FIRST_CLIENT) {
+      uint64_t idle_ns = monotonic_ns() - active_ns;
+      if (idle_ns >= daemon->idle_timeout_ns) {
+        if (daemon_retire(daemon, listen_fd)) {
+          fprintf(stderr, "idle for %.3fs, exiting.\n", (double)idle_ns / NANOSECONDS_PER_SECOND);
+          break;
+        }
+        active_ns = monotonic_ns();
+        idle_ns = 0;
+      }
+      uint64_t remaining_ms = (daemon->idle_timeout_ns - idle_ns + 999999) / 1000000;
+      timeout_ms = remaining_ms < INT_MAX ? (int)remaining_ms : INT_MAX;
+    }
+
+    // The input reports follow the display as it is reopened.
+    fds[2].fd = daemon->input_fd;
+    if (poll(fds, nfds, timeout_ms) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "error: poll failed: %s\n", strerror(errno));
+      return;
+    }
+
+    // Follow the display before processing requests, which may then use it.
+    if (fds[1].revents & POLLIN) {
+      // Opening a display reads its brightness. Events are handled even if the lock is not
+      // acquired, since they must be drained.
+      struct device_lock lock;
+      device_lock_acquire(&lock, DEVICE_LOCK_WAIT_FOREVER);
+      daemon_hotplug(daemon);
+      device_lock_release(&lock);
+    }
+    if (fds[2].revents && daemon->input_fd == fds[2].fd) {
+      daemon_input(daemon);
+    }
+
+    // Accept every waiting client, and read its requests in this round: `apdbctl-client` connects
+    // for a single request, so this is where requests of concurrent clients are coalesced.
+    while (fds[0].revents & POLLIN) {
+      int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (client < 0 && errno == EINTR) {
+        continue;
+      }
+      if (client < 0) {
+        break;
+      }
+      if (nfds == FIRST_CLIENT + MAX_CLIENTS) {
+        fprintf(stderr, "warning: too many clients, dropping connection.\n");
+        close(client);
+        continue;
+      }
+      fds[nfds++] = (struct pollfd){.fd = client, .events = POLLIN, .revents = POLLIN};
+    }
+
+    size_t count = 0;
+    for (nfds_t i = FIRST_CLIENT; i < nfds; ++i) {
+      for (int j = 0; fds[i].revents && j < MAX_REQUESTS_PER_CLIENT; ++j) {
+        struct daemon_request* request = &pending[count].request;
+        // With MSG_TRUNC, the full length of the datagram is returned, even if it was truncated.
+        ssize_t bytes_read = recv(fds[i].fd, request, sizeof(*request), MSG_DONTWAIT | MSG_TRUNC);
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EINTR)) {
+          break;
+        }
+        if (bytes_read <= 0) {
+          disconnected[i] = true;
+          break;
+        }
+        if (bytes_read != sizeof(*request)) {
+          // Answered with ERR_INVALID_ARGUMENT, as requests failing `daemon_is_valid` are.
+          *request = (struct daemon_request){0};
+        }
+        pending[count++].fd = fds[i].fd;
+      }
+    }
+
+    daemon_process(daemon, pending, count);
+    if (count || nfds > FIRST_CLIENT) {
+      active_ns = monotonic_ns();
+    }
+
+    for (nfds_t i = FIRST_CLIENT; i < nfds; ++i) {
+      if (disconnected[i]) {
+        close(fds[i].fd);
+        disconnected[i] = disconnected[nfds - 1];
+        disconnected[nfds - 1] = false;
+        fds[i--] = fds[--nfds];
+      }
+    }
+  }
+
+  for (nfds_t i = FIRST_CLIENT; i < nfds; ++i) {
+    close(fds[i].fd);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  // Fail if API version majors differ. Better safe than sending the wrong command to the device.
+  if (HID_API_VERSION_MAJOR != hid_version()->major) {
+    fprintf(stderr, "This program was built with a different version of hidapi.\n");
+    return ERR_INVALID_PRECONDITION;
+  }
+
+  if (argc == 2 &&
+      (!strcmp(argv[1], "--help") || !strcmp(argv[1], "-h") || !strcmp(argv[1], "help"))) {
+    print_usage(argv[0]);
+    return SUCCESS;
+  }
+
+  uint64_t idle_timeout_ns = 0;
+  if (argc == 3 && !strcmp(argv[1], "--idle-timeout")) {
+    if (!parse_duration(argv[2], &idle_timeout_ns) || !idle_timeout_ns) {
+      fprintf(stderr, "error: invalid duration '%s', e.g. \"500ms\" or \"2s\".\n", argv[2]);
+      return ERR_INVALID_ARGUMENT;
+    }
+  } else if (argc != 1) {
+    fprintf(stderr, "error: invalid parameters\n");
+    print_usage(argv[0]);
+    return ERR_INVALID_ARGUMENT;
+  }
+
+  struct sigaction action = {.sa_handler = on_terminate};
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+  int listen_fd = daemon_listen(path, sizeof(path));
+  if (listen_fd < 0) {
+    return ERR_INVALID_PRECONDITION;
+  }
+
+  // Open the device eagerly so that the first request does not pay for the lookup. The device is
+  // opened when it is connected, or looked up again on demand without a hotplug monitor. The
+  // monitor is started first, so that a display connected during the lookup is not missed.
+  struct daemon daemon = {
+      .hotplug_fd = hotplug_open(),
+      .input_fd = -1,
+      .shadow = -1,
+      .status = status_page_create(),
+      .idle_timeout_ns = idle_timeout_ns,
+      .spawn_lock_fd = -1,
+  };
+  statistics_enabled = true;
+  struct device_lock lock;
+  if (device_lock_acquire(&lock, DEVICE_LOCK_WAIT_FOREVER)) {
+    daemon_device(&daemon);
+    device_lock_release(&lock);
+  }
+
+  daemon_serve(&daemon, listen_fd);
+
+  char text[DAEMON_STATISTICS_SIZE];
+  format_daemon_statistics(&daemon, text, sizeof(text));
+  fputs(text, stderr);
+
+  close(listen_fd);
+  unlink(path);
+  daemon_close_device(&daemon);
+  status_page_destroy(daemon.status);
+  if (daemon.hotplug_fd >= 0) {
+    close(daemon.hotplug_fd);
+  }
+  if (daemon.spawn_lock_fd >= 0) {
+    close(daemon.spawn_lock_fd);
+  }
+  hid_exit();
+  return SUCCESS;
+}
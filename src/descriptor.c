@@ -0,0 +1,386 @@
+#include "descriptor.h"
+
+#include <string.h>
+
+// Item types and tags, see section 6.2.2 of the Device Class Definition for HID 1.11.
+#define ITEM_TYPE_MAIN 0x0
+#define ITEM_TYPE_GLOBAL 0x1
+#define ITEM_TYPE_LOCAL 0x2
+#define ITEM_LONG 0xfe
+
+#define MAIN_INPUT 0x8
+#define MAIN_OUTPUT 0x9
+#define MAIN_COLLECTION 0xa
+#define MAIN_FEATURE 0xb
+#define MAIN_END_COLLECTION 0xc
+
+#define GLOBAL_USAGE_PAGE 0x0
+#define GLOBAL_LOGICAL_MINIMUM 0x1
+#define GLOBAL_LOGICAL_MAXIMUM 0x2
+#define GLOBAL_UNIT_EXPONENT 0x5
+#define GLOBAL_UNIT 0x6
+#define GLOBAL_REPORT_SIZE 0x7
+#define GLOBAL_REPORT_ID 0x8
+#define GLOBAL_REPORT_COUNT 0x9
+#define GLOBAL_PUSH 0xa
+#define GLOBAL_POP 0xb
+
+#define LOCAL_USAGE 0x0
+#define LOCAL_USAGE_MINIMUM 0x1
+#define LOCAL_USAGE_MAXIMUM 0x2
+
+#define COLLECTION_APPLICATION 0x1
+#define MAIN_FLAG_CONSTANT 0x1
+
+#define MAX_USAGES 32
+#define MAX_GLOBAL_STACK 4
+#define MAX_COLLECTION_DEPTH 16
+// The largest report the Linux kernel accepts, in bits.
+#define MAX_REPORT_BITS (8 * 16384)
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+/**
+ * @brief The global items in effect, which persist from one main item to the next.
+ *
+ * @param logical_maximum_unsigned The logical maximum read as an unsigned value, for descriptors
+ *   that declare a non-negative range without a sign bit to spare.
+ */
+struct global_state {
+  uint16_t usage_page;
+  int32_t logical_minimum;
+  int32_t logical_maximum;
+  uint32_t logical_maximum_unsigned;
+  uint32_t unit;
+  int8_t unit_exponent;
+  uint32_t report_size;
+  uint8_t report_id;
+  uint32_t report_count;
+};
+
+/**
+ * @brief The local items in effect, which only apply to the next main item.
+ *
+ * @param usages The usages declared one by one, page in the high 16 bits.
+ * @param usage_minimum The first usage of a range, if `has_range`.
+ * @param usage_maximum The last usage of a range, if `has_range`.
+ */
+struct local_state {
+  uint32_t usages[MAX_USAGES];
+  size_t usage_count;
+  uint32_t usage_minimum;
+  uint32_t usage_maximum;
+  bool has_range;
+};
+
+/**
+ * @brief Returns the number of distinct usages of a main item.
+ */
+static uint32_t local_usage_count(const struct local_state* local) {
+  if (local->usage_count) {
+    return local->usage_count;
+  }
+  if (local->has_range && local->usage_maximum >= local->usage_minimum) {
+    return local->usage_maximum - local->usage_minimum + 1;
+  }
+  return 1;
+}
+
+/**
+ * @brief Returns the usage of an element of a main item.
+ *
+ * Elements past the last usage share it, as the specification requires.
+ */
+static uint32_t local_usage(const struct local_state* local, uint32_t index) {
+  uint32_t count = local_usage_count(local);
+  index = index < count ? index : count - 1;
+
+  if (local->usage_count) {
+    return local->usages[index];
+  }
+  return local->has_range ? local->usage_minimum + index : 0;
+}
+
+/**
+ * @brief Reads the little-endian data of a short item.
+ *
+ * @param data[in] The data bytes.
+ * @param size[in] The number of data bytes, 0, 1, 2 or 4.
+ * @param is_signed[in] Whether to sign-extend the value.
+ * @return The value.
+ */
+static uint32_t item_value(const unsigned char* data, size_t size, bool is_signed) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < size; ++i) {
+    value |= (uint32_t)data[i] << (8 * i);
+  }
+  if (is_signed && size && size < 4 && data[size - 1] & 0x80) {
+    value |= ~0u << (8 * size);
+  }
+  return value;
+}
+
+/**
+ * @brief Returns the report of a type and ID, adding it to the layout if needed.
+ *
+ * @return The report, or NULL if the layout has no room left.
+ */
+static struct hid_report* layout_report(struct hid_report_layout* layout,
+                                        enum hid_report_type type, uint8_t report_id) {
+  for (size_t i = 0; i < layout->report_count; ++i) {
+    if (layout->reports[i].type == type && layout->reports[i].report_id == report_id) {
+      return &layout->reports[i];
+    }
+  }
+  if (layout->report_count == HID_MAX_REPORTS) {
+    return NULL;
+  }
+
+  struct hid_report* report = &layout->reports[layout->report_count++];
+  *report = (struct hid_report){.type = type, .report_id = report_id};
+  return report;
+}
+
+/**
+ * @brief Records the fields of an input, output or feature main item.
+ *
+ * @param layout[in,out] The layout being parsed.
+ * @param type[in] The type of the main item.
+ * @param flags[in] The data of the main item.
+ * @param global[in] The global items in effect.
+ * @param local[in] The local items of the main item.
+ * @param application[in] The usage of the enclosing application collection.
+ * @return Whether the item fits in its report.
+ */
+static bool add_main_item(struct hid_report_layout* layout, enum hid_report_type type,
+                          uint32_t flags, const struct global_state* global,
+                          const struct local_state* local, uint32_t application) {
+  struct hid_report* report = layout_report(layout, type, global->report_id);
+  uint64_t bit_size = (uint64_t)global->report_size * global->report_count;
+  if (!report || report->bit_size + bit_size > MAX_REPORT_BITS) {
+    return false;
+  }
+
+  // Constant items are padding: they only take room in the report.
+  uint32_t usages = local_usage_count(local);
+  for (uint32_t i = 0; !(flags & MAIN_FLAG_CONSTANT) && i < global->report_count;) {
+    // Elements past the last usage are gathered into a single field.
+    uint32_t count = i + 1 < usages ? 1 : global->report_count - i;
+    if (layout->field_count < HID_MAX_FIELDS) {
+      bool is_unsigned = global->logical_minimum >= 0 && global->logical_maximum < 0;
+      layout->fields[layout->field_count++] = (struct hid_field){
+          .type = type,
+          .report_id = global->report_id,
+          .application = application,
+          .usage = local_usage(local, i),
+          .logical_minimum = global->logical_minimum,
+          .logical_maximum = !is_unsigned ? global->logical_maximum
+                             : global->logical_maximum_unsigned > INT32_MAX
+                                 ? INT32_MAX
+                                 : (int32_t)global->logical_maximum_unsigned,
+          .unit = global->unit,
+          .unit_exponent = global->unit_exponent,
+          .bit_offset = report->bit_size + i * global->report_size,
+          .bit_size = global->report_size,
+          .count = count,
+      };
+    }
+    i += count;
+  }
+
+  report->bit_size += bit_size;
+  return true;
+}
+
+/**
+ * @brief Parses a HID report descriptor item by item.
+ *
+ * Extracts the reports the device sends and accepts, and the usage, logical range, unit and
+ * position of each of their fields, independently of the order the items are declared in.
+ *
+ * @param descriptor[in] The report descriptor.
+ * @param size[in] The size of `descriptor`.
+ * @param layout[out] The reports and fields declared by the descriptor.
+ * @return Whether the descriptor is well formed.
+ */
+bool parse_report_descriptor(const unsigned char* descriptor, size_t size,
+                             struct hid_report_layout* layout) {
+  struct global_state global = {0};
+  struct global_state global_stack[MAX_GLOBAL_STACK];
+  size_t global_depth = 0;
+  struct local_state local = {0};
+  uint32_t applications[MAX_COLLECTION_DEPTH];
+  size_t collection_depth = 0;
+  uint32_t application = 0;
+
+  memset(layout, 0, sizeof(*layout));
+
+  for (size_t offset = 0; offset < size;) {
+    unsigned char prefix = descriptor[offset];
+    if (prefix == ITEM_LONG) {
+      // Long items are reserved, and carry nothing this parser understands.
+      if (offset + 1 >= size) {
+        return false;
+      }
+      offset += 3 + descriptor[offset + 1];
+      continue;
+    }
+
+    size_t data_size = (prefix & 0x3) == 0x3 ? 4 : prefix & 0x3;
+    unsigned int type = prefix >> 2 & 0x3;
+    unsigned int tag = prefix >> 4;
+    const unsigned char* data = &descriptor[offset + 1];
+    if (offset + 1 + data_size > size) {
+      return false;
+    }
+    offset += 1 + data_size;
+
+    uint32_t value = item_value(data, data_size, /* is_signed= */ false);
+    int32_t signed_value = (int32_t)item_value(data, data_size, /* is_signed= */ true);
+
+    if (type == ITEM_TYPE_MAIN) {
+      switch (tag) {
+        case MAIN_INPUT:
+        case MAIN_OUTPUT:
+        case MAIN_FEATURE: {
+          enum hid_report_type report_type = tag == MAIN_INPUT    ? HID_REPORT_INPUT
+                                             : tag == MAIN_OUTPUT ? HID_REPORT_OUTPUT
+                                                                  : HID_REPORT_FEATURE;
+          if (!add_main_item(layout, report_type, value, &global, &local, application)) {
+            return false;
+          }
+          break;
+        }
+        case MAIN_COLLECTION:
+          if (collection_depth == MAX_COLLECTION_DEPTH) {
+            return false;
+          }
+          applications[collection_depth++] = application;
+          if (value == COLLECTION_APPLICATION) {
+            application = local_usage(&local, 0);
+          }
+          break;
+        case MAIN_END_COLLECTION:
+          if (!collection_depth) {
+            return false;
+          }
+          application = applications[--collection_depth];
+          break;
+      }
+      local = (struct local_state){0};
+    } else if (type == ITEM_TYPE_GLOBAL) {
+      switch (tag) {
+        case GLOBAL_USAGE_PAGE:
+          global.usage_page = value;
+          break;
+        case GLOBAL_LOGICAL_MINIMUM:
+          global.logical_minimum = signed_value;
+          break;
+        case GLOBAL_LOGICAL_MAXIMUM:
+          global.logical_maximum = signed_value;
+          global.logical_maximum_unsigned = value;
+          break;
+        case GLOBAL_UNIT_EXPONENT:
+          // Encoded in the low nibble, although some devices use a whole byte.
+          global.unit_exponent = value < 0x10 ? (int8_t)(value << 4) >> 4 : (int8_t)signed_value;
+          break;
+        case GLOBAL_UNIT:
+          global.unit = value;
+          break;
+        case GLOBAL_REPORT_SIZE:
+          global.report_size = value;
+          break;
+        case GLOBAL_REPORT_ID:
+          if (!value || value > 0xff) {
+            return false;
+          }
+          global.report_id = value;
+          break;
+        case GLOBAL_REPORT_COUNT:
+          global.report_count = value;
+          break;
+        case GLOBAL_PUSH:
+          if (global_depth == MAX_GLOBAL_STACK) {
+            return false;
+          }
+          global_stack[global_depth++] = global;
+          break;
+        case GLOBAL_POP:
+          if (!global_depth) {
+            return false;
+          }
+          global = global_stack[--global_depth];
+          break;
+      }
+    } else if (type == ITEM_TYPE_LOCAL) {
+      // Usages of 4 bytes carry their own page, shorter ones use the current usage page.
+      uint32_t usage = data_size == 4 ? value : (uint32_t)global.usage_page << 16 | value;
+      switch (tag) {
+        case LOCAL_USAGE:
+          if (local.usage_count < MAX_USAGES) {
+            local.usages[local.usage_count++] = usage;
+          }
+          break;
+        case LOCAL_USAGE_MINIMUM:
+          local.usage_minimum = usage;
+          local.has_range = true;
+          break;
+        case LOCAL_USAGE_MAXIMUM:
+          local.usage_maximum = usage;
+          local.has_range = true;
+          break;
+      }
+    }
+  }
+
+  return collection_depth == 0;
+}
+
+/**
+ * @brief Finds the first field of a type with a usage.
+ *
+ * @param layout[in] The parsed layout.
+ * @param type[in] The type of report the field belongs to.
+ * @param usage[in] The usage of the field, page in the high 16 bits.
+ * @return The field, or NULL if there is none.
+ */
+const struct hid_field* find_hid_field(const struct hid_report_layout* layout,
+                                       enum hid_report_type type, uint32_t usage) {
+  for (size_t i = 0; i < layout->field_count; ++i) {
+    if (layout->fields[i].type == type && layout->fields[i].usage == usage) {
+      return &layout->fields[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Returns the length of the data of a report, excluding its report ID.
+ *
+ * @param layout[in] The parsed layout.
+ * @param type[in] The type of the report.
+ * @param report_id[in] The ID of the report, or 0 if the device does not use report IDs.
+ * @return The length of the report in bytes, or 0 if the descriptor does not declare it.
+ */
+size_t hid_report_length(const struct hid_report_layout* layout, enum hid_report_type type,
+                         uint8_t report_id) {
+  for (size_t i = 0; i < layout->report_count; ++i) {
+    const struct hid_report* report = &layout->reports[i];
+    if (report->type == type && report->report_id == report_id) {
+      return (report->bit_size + 7) / 8;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Hashes a report descriptor with 64-bit FNV-1a, to key the cache of parsed layouts.
+ */
+uint64_t hash_report_descriptor(const unsigned char* descriptor, size_t size) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ descriptor[i]) * FNV_PRIME;
+  }
+  return hash;
+}
@@ -0,0 +1,81 @@
+#ifndef APDBCTL_DESCRIPTOR_H
+#define APDBCTL_DESCRIPTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The largest report descriptor a HID device may have, as defined by the Linux kernel.
+#define HID_MAX_DESCRIPTOR_SIZE 4096
+#define HID_MAX_FIELDS 64
+#define HID_MAX_REPORTS 32
+
+enum hid_report_type {
+  HID_REPORT_INPUT,
+  HID_REPORT_OUTPUT,
+  HID_REPORT_FEATURE,
+};
+
+/**
+ * @brief A data field of a report, i.e. the elements of a main item sharing a usage.
+ *
+ * @param type The type of the report the field belongs to.
+ * @param report_id The ID of the report, or 0 if the device does not use report IDs.
+ * @param application The usage of the enclosing application collection, page in the high 16 bits.
+ * @param usage The usage of the field, page in the high 16 bits.
+ * @param logical_minimum The minimum value of the field.
+ * @param logical_maximum The maximum value of the field.
+ * @param unit The unit of the field, as encoded in the descriptor.
+ * @param unit_exponent The base 10 exponent of the unit.
+ * @param bit_offset The offset of the first element, in bits from the end of the report ID.
+ * @param bit_size The size of each element, in bits.
+ * @param count The number of elements.
+ */
+struct hid_field {
+  enum hid_report_type type;
+  uint8_t report_id;
+  uint32_t application;
+  uint32_t usage;
+  int32_t logical_minimum;
+  int32_t logical_maximum;
+  uint32_t unit;
+  int8_t unit_exponent;
+  uint32_t bit_offset;
+  uint32_t bit_size;
+  uint32_t count;
+};
+
+/**
+ * @brief The size of a report.
+ *
+ * @param type The type of the report.
+ * @param report_id The ID of the report, or 0 if the device does not use report IDs.
+ * @param bit_size The size of the report, in bits, excluding the report ID.
+ */
+struct hid_report {
+  enum hid_report_type type;
+  uint8_t report_id;
+  uint32_t bit_size;
+};
+
+/**
+ * @brief The reports and fields declared by a report descriptor.
+ *
+ * Fields beyond `HID_MAX_FIELDS` are not recorded, but still counted in the size of their report.
+ */
+struct hid_report_layout {
+  size_t field_count;
+  struct hid_field fields[HID_MAX_FIELDS];
+  size_t report_count;
+  struct hid_report reports[HID_MAX_REPORTS];
+};
+
+bool parse_report_descriptor(const unsigned char* descriptor, size_t size,
+                             struct hid_report_layout* layout);
+const struct hid_field* find_hid_field(const struct hid_report_layout* layout,
+                                       enum hid_report_type type, uint32_t usage);
+size_t hid_report_length(const struct hid_report_layout* layout, enum hid_report_type type,
+                         uint8_t report_id);
+uint64_t hash_report_descriptor(const unsigned char* descriptor, size_t size);
+
+#endif  // APDBCTL_DESCRIPTOR_H
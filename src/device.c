@@ -0,0 +1,1468 @@
+#include "device.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#endif
+
+#include "brightness.h"
+#include "clock.h"
+#include "descriptor.h"
+#include "runtime.h"
+#include "stats.h"
+#include "trace.h"
+
+#define APPLE_INC 0x05ac
+#define PRO_DISPLAY_XDR 0x9243
+#define BRIGHTNESS_REPORT_ID 0x1
+#define BRIGHTNESS_REPORT_MAX_LENGTH 64
+// Fewer input reports than hidraw buffers per handle (64), so that none was dropped when draining.
+#define INPUT_DRAIN_LIMIT 32
+#define MONITOR_PAGE 0x80
+#define VESA_VIRTUAL_CONTROLS_PAGE 0x82
+#define BRIGHTNESS_USAGE 0x10
+#define DEVICE_CACHE_NAME "device"
+#define LAYOUT_CACHE_PREFIX "layout-"
+#define LAYOUT_CACHE_NONE "none"
+#define SYSFS_HIDRAW_DIRECTORY "/sys/class/hidraw"
+#define SYSFS_HID_DEVICES_DIRECTORY "/sys/bus/hid/devices"
+
+// The simulated hidapi backend only knows about its own devices, which sysfs does not list.
+#if defined(__linux__) && !defined(APDBCTL_MOCK_HIDAPI)
+#define HAVE_SYSFS_DISCOVERY 1
+#endif
+
+// The hidraw backend relies on sysfs for everything hidapi would otherwise look up.
+#if defined(HAVE_SYSFS_DISCOVERY) && defined(APDBCTL_HIDRAW_BACKEND)
+#define HAVE_HIDRAW_BACKEND 1
+#include "hidraw.h"
+#endif
+
+#define HIDRAW_DEVICE_PREFIX "/dev/hidraw"
+
+/**
+ * @brief An open brightness control device.
+ *
+ * @param hid The device opened through hidapi, or NULL.
+ * @param fd The hidraw node opened directly, or -1.
+ * @param layout The layout of the brightness reports.
+ */
+struct device {
+  hid_device* hid;
+  int fd;
+  struct brightness_layout layout;
+};
+
+// The layout documented in README.md, for devices opened without looking at their descriptor.
+static const struct brightness_layout default_brightness_layout = {
+    .report_id = BRIGHTNESS_REPORT_ID,
+    .size = sizeof(uint32_t),
+    .feature_length = 7,
+    .feature_offset = 1,
+    .input_length = 5,
+    .input_offset = 1,
+    .minimum = BRIGHTNESS_MIN,
+    .maximum = BRIGHTNESS_MAX,
+    .unit = 0x010000e1,
+    .unit_exponent = -2,
+};
+
+enum device_backend {
+  DEVICE_BACKEND_UNSET,
+  DEVICE_BACKEND_HIDAPI,
+  DEVICE_BACKEND_HIDRAW,
+};
+
+static enum device_backend device_backend = DEVICE_BACKEND_UNSET;
+
+// Whether device errors are printed on standard error, besides being kept for `device_last_error`.
+bool device_errors_printed = true;
+
+// The last device error of the calling thread, without the "error: " prefix.
+static _Thread_local char device_error[256];
+
+/**
+ * @brief Records a device error for `device_last_error`, and prints it on standard error unless
+ * `device_errors_printed` is unset.
+ *
+ * @param format[in] The printf-style format of the message, without a trailing newline.
+ */
+static void __attribute__((format(printf, 1, 2))) report_device_error(const char* format, ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  vsnprintf(device_error, sizeof(device_error), format, arguments);
+  va_end(arguments);
+  if (device_errors_printed) {
+    fprintf(stderr, "error: %s\n", device_error);
+  }
+}
+
+/**
+ * @brief Returns the last device error of the calling thread, empty if none.
+ */
+const char* device_last_error(void) {
+  return device_error;
+}
+
+/**
+ * @brief Checks whether a device is from an Apple Pro Display XDR.
+ *
+ * The Pro Display XDR advertises 4 HID interfaces, but only one of them is capable of brightness
+ * control. This only checks if this is one of the 4 advertised interfaces.
+ *
+ * @param device[in] The HID device to inspect.
+ * @return Whether the device's vendor and product IDs matches that of the Apple Pro Display XDR.
+ * @see hid_is_apple_pro_display_xdr_brightness_control_device
+ */
+static bool is_apple_pro_display_xdr_device(struct hid_device_info* device) {
+  return device->vendor_id == APPLE_INC && device->product_id == PRO_DISPLAY_XDR;
+}
+
+/**
+ * @brief Converts a serial number reported by hidapi, truncating it to the buffer.
+ *
+ * Serial numbers are ASCII: other characters are replaced with '?', rather than depending on the
+ * locale as `%ls` does.
+ *
+ * @param serial[out] The serial number, NUL-terminated.
+ * @param size[in] The size of `serial`, at least 1.
+ * @param wide[in] The serial number reported by hidapi, or NULL if unknown.
+ */
+static void convert_serial_number(char* serial, size_t size, const wchar_t* wide) {
+  size_t length = 0;
+  for (; wide && wide[length] && length < size - 1; ++length) {
+    serial[length] = wide[length] > 0 && wide[length] < 0x80 ? (char)wide[length] : '?';
+  }
+  serial[length] = '\0';
+}
+
+/**
+ * @brief Reads a file of the runtime directory.
+ *
+ * @param name[in] The name of the file.
+ * @param buffer[out] The contents of the file, NUL-terminated.
+ * @param size[in] The size of `buffer`.
+ * @return Whether the file was read and is not empty.
+ */
+static bool read_runtime_file(const char* name, char* buffer, size_t size) {
+  char path[PATH_MAX];
+  if (!runtime_path(path, sizeof(path), name, /* create_directory= */ false)) {
+    return false;
+  }
+
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    return false;
+  }
+
+  size_t length = fread(buffer, 1, size - 1, file);
+  fclose(file);
+  buffer[length] = '\0';
+  return length > 0;
+}
+
+/**
+ * @brief Writes a file of the runtime directory for subsequent invocations.
+ *
+ * Caches are best effort: failures are silently ignored. The file is written to a temporary
+ * location then renamed so that concurrent invocations never observe a partial file.
+ *
+ * @param name[in] The name of the file.
+ * @param contents[in] The contents of the file.
+ */
+static void write_runtime_file(const char* name, const char* contents) {
+  char path[PATH_MAX];
+  char temporary_path[PATH_MAX + 16];
+  if (!runtime_path(path, sizeof(path), name, /* create_directory= */ true)) {
+    return;
+  }
+  snprintf(temporary_path, sizeof(temporary_path), "%s.%ld", path, (long)getpid());
+
+  FILE* file = fopen(temporary_path, "w");
+  if (!file) {
+    return;
+  }
+
+  bool success = fputs(contents, file) >= 0;
+  success = !fclose(file) && success;
+
+  if (!success || rename(temporary_path, path) < 0) {
+    unlink(temporary_path);
+  }
+}
+
+/**
+ * @brief Extracts the layout of the brightness reports from a parsed report descriptor.
+ *
+ * The brightness control interface is the one declaring a brightness feature (VESA Virtual
+ * Controls page) in a Monitor page application collection, over the documented range. The input
+ * report the display sends when its brightness changes is optional.
+ *
+ * @param parsed[in] The parsed report descriptor.
+ * @param layout[out] The layout of the brightness reports.
+ * @return Whether the descriptor is that of the Apple Pro Display XDR brightness control device.
+ */
+static bool find_brightness_layout(const struct hid_report_layout* parsed,
+                                   struct brightness_layout* layout) {
+  uint32_t usage = (uint32_t)VESA_VIRTUAL_CONTROLS_PAGE << 16 | BRIGHTNESS_USAGE;
+  const struct hid_field* feature = find_hid_field(parsed, HID_REPORT_FEATURE, usage);
+  if (!feature || feature->application >> 16 != MONITOR_PAGE ||
+      feature->logical_minimum != BRIGHTNESS_MIN || feature->logical_maximum != BRIGHTNESS_MAX ||
+      feature->bit_offset % 8 || feature->bit_size % 8 || !feature->bit_size ||
+      feature->bit_size > 32) {
+    return false;
+  }
+
+  size_t feature_length = 1 + hid_report_length(parsed, HID_REPORT_FEATURE, feature->report_id);
+  if (feature_length > BRIGHTNESS_REPORT_MAX_LENGTH) {
+    return false;
+  }
+
+  *layout = (struct brightness_layout){
+      .report_id = feature->report_id,
+      .size = feature->bit_size / 8,
+      .feature_length = feature_length,
+      .feature_offset = 1 + feature->bit_offset / 8,
+      .minimum = feature->logical_minimum,
+      .maximum = feature->logical_maximum,
+      .unit = feature->unit,
+      .unit_exponent = feature->unit_exponent,
+  };
+
+  // Input reports only start with their report ID if the device uses report IDs.
+  const struct hid_field* input = find_hid_field(parsed, HID_REPORT_INPUT, usage);
+  if (input && input->report_id == feature->report_id && input->bit_size == feature->bit_size &&
+      !(input->bit_offset % 8)) {
+    size_t input_length = (input->report_id != 0) +
+                          hid_report_length(parsed, HID_REPORT_INPUT, input->report_id);
+    if (input_length <= BRIGHTNESS_REPORT_MAX_LENGTH) {
+      layout->input_length = input_length;
+      layout->input_offset = (input->report_id != 0) + input->bit_offset / 8;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Looks up the layout extracted from a report descriptor by a previous invocation.
+ *
+ * @param hash[in] The hash of the report descriptor.
+ * @param found[out] Whether the descriptor is that of a brightness control device.
+ * @param layout[out] The layout of the brightness reports, if `found`.
+ * @return Whether the descriptor was known.
+ */
+static bool read_layout_cache(uint64_t hash, bool* found, struct brightness_layout* layout) {
+  char name[64];
+  char contents[128];
+  snprintf(name, sizeof(name), LAYOUT_CACHE_PREFIX "%016llx", (unsigned long long)hash);
+  if (!read_runtime_file(name, contents, sizeof(contents))) {
+    return false;
+  }
+
+  *found = strncmp(contents, LAYOUT_CACHE_NONE, strlen(LAYOUT_CACHE_NONE));
+  if (!*found) {
+    return true;
+  }
+
+  // Values are checked before they are narrowed, so that a damaged cache is treated as a miss and
+  // the descriptor parsed again, rather than sending truncated report IDs or reading out of bounds.
+  unsigned int values[6];
+  int exponent;
+  *layout = (struct brightness_layout){.descriptor_hash = hash};
+  if (sscanf(contents, "%u %u %u %u %u %u %" SCNd32 " %" SCNd32 " %" SCNx32 " %d", &values[0],
+             &values[1], &values[2], &values[3], &values[4], &values[5], &layout->minimum,
+             &layout->maximum, &layout->unit, &exponent) != 10 ||
+      values[0] > UINT8_MAX || !values[1] || values[1] > sizeof(uint32_t) ||
+      values[2] > BRIGHTNESS_REPORT_MAX_LENGTH || values[3] > values[2] ||
+      values[3] + values[1] > values[2] || values[4] > BRIGHTNESS_REPORT_MAX_LENGTH ||
+      values[5] > BRIGHTNESS_REPORT_MAX_LENGTH ||
+      (values[4] && values[5] + values[1] > values[4]) || exponent < INT8_MIN ||
+      exponent > INT8_MAX) {
+    return false;
+  }
+
+  layout->report_id = values[0];
+  layout->size = values[1];
+  layout->feature_length = values[2];
+  layout->feature_offset = values[3];
+  layout->input_length = values[4];
+  layout->input_offset = values[5];
+  layout->unit_exponent = exponent;
+  return true;
+}
+
+/**
+ * @brief Records the layout extracted from a report descriptor for subsequent invocations.
+ *
+ * @param hash[in] The hash of the report descriptor.
+ * @param layout[in] The layout of the brightness reports, or NULL if the descriptor is not that of
+ *   a brightness control device.
+ */
+static void write_layout_cache(uint64_t hash, const struct brightness_layout* layout) {
+  char name[64];
+  char contents[128];
+  snprintf(name, sizeof(name), LAYOUT_CACHE_PREFIX "%016llx", (unsigned long long)hash);
+
+  if (!layout) {
+    snprintf(contents, sizeof(contents), "%s\n", LAYOUT_CACHE_NONE);
+  } else {
+    snprintf(contents, sizeof(contents),
+             "%u %u %u %u %u %u %" PRId32 " %" PRId32 " %" PRIx32 " %d\n", layout->report_id,
+             layout->size, layout->feature_length, layout->feature_offset, layout->input_length,
+             layout->input_offset, layout->minimum, layout->maximum, layout->unit,
+             layout->unit_exponent);
+  }
+  write_runtime_file(name, contents);
+}
+
+/**
+ * @brief Checks whether a report descriptor is that of the Apple Pro Display XDR brightness control
+ * device, and extracts the layout of its brightness reports.
+ *
+ * Parsed layouts are cached by descriptor hash, so that a descriptor is only parsed once.
+ *
+ * @param descriptor[in] The report descriptor.
+ * @param size[in] The size of `descriptor`.
+ * @param layout[out] The layout of the brightness reports.
+ * @return Whether the descriptor matches that of the Apple Pro Display XDR brightness control
+ *   device.
+ * @see README.md
+ */
+static bool is_apple_pro_display_xdr_brightness_control_descriptor(
+    const unsigned char* descriptor, size_t size, struct brightness_layout* layout) {
+  uint64_t hash = hash_report_descriptor(descriptor, size);
+  bool found;
+  if (read_layout_cache(hash, &found, layout)) {
+    return found;
+  }
+
+  struct hid_report_layout parsed;
+  uint64_t start_ns = trace_begin();
+  found = parse_report_descriptor(descriptor, size, &parsed) &&
+          find_brightness_layout(&parsed, layout);
+  trace_end("parse_descriptor", NULL, start_ns);
+  statistics_add(STAT_DESCRIPTOR_PARSES, 1);
+
+  layout->descriptor_hash = hash;
+  write_layout_cache(hash, found ? layout : NULL);
+  return found;
+}
+
+/**
+ * @brief Reports the last error of a device, see `report_device_error`.
+ *
+ * @param device[in] The device that failed.
+ * @param message[in] The operation that failed.
+ */
+static void report_hid_error(struct device* device, const char* message) {
+  if (device->hid) {
+    report_device_error("%s: %ls", message, hid_error(device->hid));
+  } else {
+    report_device_error("%s: %s", message, strerror(errno));
+  }
+}
+
+/**
+ * @brief Checks whether a device is an Apple Pro Display XDR brightness control device.
+ *
+ * The Pro Display XDR advertises 4 HID interfaces, but only one of them is capable of brightness
+ * control. This only checks if the report descriptor of the given `device` matches the Apple Pro
+ * Display XDR brightness control device.
+ *
+ * @param device[in] The HID device to inspect.
+ * @param layout[out] The layout of the brightness reports of the device.
+ * @return Whether the device's report descriptor matches that of the Apple Pro Display XDR
+ *   brightness control device.
+ * @see hid_is_apple_pro_display_xdr_device
+ */
+static bool hid_is_apple_pro_display_xdr_brightness_control_device(
+    struct device* device, struct brightness_layout* layout) {
+  unsigned char descriptor[HID_MAX_DESCRIPTOR_SIZE];
+
+  uint64_t start_ns = trace_begin();
+  int bytes_read;
+#if defined(HAVE_HIDRAW_BACKEND)
+  if (device->fd >= 0) {
+    bytes_read = hidraw_get_report_descriptor(device->fd, descriptor, sizeof(descriptor));
+  } else
+#endif
+    bytes_read = hid_get_report_descriptor(device->hid, descriptor, sizeof(descriptor));
+  trace_end("report_descriptor", NULL, start_ns);
+  statistics_add(STAT_DESCRIPTOR_FETCHES, 1);
+
+  if (bytes_read <= 0) {
+    report_hid_error(device, "found Apple Pro Display XDR device but failed to retrieve "
+                               "Report Descriptor");
+    return false;
+  }
+
+  return is_apple_pro_display_xdr_brightness_control_descriptor(descriptor, bytes_read, layout);
+}
+
+/**
+ * @brief Wraps a device opened through hidapi.
+ *
+ * @param hid[in] The hidapi device, closed on error.
+ * @return The device, or NULL on error.
+ */
+static struct device* wrap_hid_device(hid_device* hid) {
+  struct device* device = malloc(sizeof(*device));
+  if (!device) {
+    hid_close(hid);
+    return NULL;
+  }
+  *device = (struct device){.hid = hid, .fd = -1, .layout = default_brightness_layout};
+  return device;
+}
+
+/**
+ * @brief Selects how devices are opened, overriding the `APDBCTL_BACKEND` environment variable.
+ *
+ * @param name[in] `hidapi`, or `hidraw` to use the hidraw ioctls directly where available.
+ * @return Whether the backend is known and was built in.
+ */
+bool select_device_backend(const char* name) {
+  if (!strcmp(name, "hidapi")) {
+    device_backend = DEVICE_BACKEND_HIDAPI;
+    return true;
+  }
+#if defined(HAVE_HIDRAW_BACKEND)
+  if (!strcmp(name, "hidraw")) {
+    device_backend = DEVICE_BACKEND_HIDRAW;
+    return true;
+  }
+#endif
+  return false;
+}
+
+/**
+ * @brief Returns the selected backend, defaulting to `APDBCTL_BACKEND` then hidapi.
+ */
+static enum device_backend selected_device_backend(void) {
+  if (device_backend == DEVICE_BACKEND_UNSET) {
+    const char* name = getenv("APDBCTL_BACKEND");
+    if (!name || !*name || !select_device_backend(name)) {
+      if (name && *name && device_errors_printed) {
+        fprintf(stderr, "warning: unsupported backend '%s', using hidapi.\n", name);
+      }
+      device_backend = DEVICE_BACKEND_HIDAPI;
+    }
+  }
+  return device_backend;
+}
+
+/**
+ * @brief Opens a HID device, recording the call in the trace and statistics.
+ *
+ * hidraw nodes are opened directly when the hidraw backend is selected, and through hidapi
+ * otherwise.
+ *
+ * @param path[in] The path of the HID device.
+ * @return The device, or NULL on error.
+ */
+struct device* open_device(const char* path) {
+  struct device* device = NULL;
+  uint64_t start_ns = trace_begin();
+
+  // Only ever selected when the hidraw backend is built in.
+  if (selected_device_backend() == DEVICE_BACKEND_HIDRAW &&
+      !strncmp(path, HIDRAW_DEVICE_PREFIX, strlen(HIDRAW_DEVICE_PREFIX))) {
+#if defined(HAVE_HIDRAW_BACKEND)
+    int fd = hidraw_open(path);
+    if (fd >= 0 && !(device = malloc(sizeof(*device)))) {
+      close(fd);
+    } else if (fd >= 0) {
+      *device = (struct device){.hid = NULL, .fd = fd, .layout = default_brightness_layout};
+    }
+#endif
+    trace_end("hidraw_open", path, start_ns);
+  } else {
+    hid_device* hid = hid_open_path(path);
+    device = hid ? wrap_hid_device(hid) : NULL;
+    trace_end("hid_open_path", path, start_ns);
+  }
+
+  if (device) {
+    statistics_add(STAT_DEVICES_OPENED, 1);
+    statistics_sample_fds();
+  }
+  return device;
+}
+
+/**
+ * @brief Closes a device opened with `open_device`.
+ *
+ * @param device[in] The device to close.
+ */
+void close_device(struct device* device) {
+  if (device->hid) {
+    hid_close(device->hid);
+  } else {
+    close(device->fd);
+  }
+  free(device);
+}
+
+/**
+ * @brief Appends a display to a list of displays.
+ *
+ * @param displays[in,out] The list of displays.
+ * @param count[in,out] The number of displays in the list.
+ * @param capacity[in] The capacity of the list.
+ * @param path[in] The path of the brightness control device.
+ * @param serial[in] The serial number of the display.
+ * @param layout[in] The layout of the brightness reports of the device.
+ * @param device[in] The brightness control device if already open, or NULL.
+ * @return Whether the display was added, i.e. the list was not full.
+ */
+static bool append_display(struct display* displays, size_t* count, size_t capacity,
+                           const char* path, const char* serial,
+                           const struct brightness_layout* layout, struct device* device) {
+  if (*count == capacity) {
+    return false;
+  }
+
+  struct display* display = &displays[(*count)++];
+  snprintf(display->path, sizeof(display->path), "%s", path);
+  snprintf(display->serial, sizeof(display->serial), "%s", serial);
+  display->layout = *layout;
+  display->device = device;
+  if (device) {
+    device->layout = *layout;
+  }
+  return true;
+}
+
+/**
+ * @brief Opens the device of a display, which then uses the layout of the display reports.
+ *
+ * @param display[in,out] The display, whose `device` is set.
+ * @return Whether the device was opened.
+ */
+static bool open_display_device(struct display* display) {
+  display->device = open_device(display->path);
+  if (!display->device) {
+    return false;
+  }
+  display->device->layout = display->layout;
+  return true;
+}
+
+#if defined(HAVE_SYSFS_DISCOVERY)
+/**
+ * @brief Reads the beginning of a file into a buffer.
+ *
+ * @param path[in] The path of the file to read.
+ * @param buffer[out] The buffer to read into.
+ * @param size[in] The maximum number of bytes to read.
+ * @return The number of bytes read, or -1 on error.
+ */
+static ssize_t read_file_prefix(const char* path, void* buffer, size_t size) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  ssize_t bytes_read = read(fd, buffer, size);
+  close(fd);
+  return bytes_read;
+}
+
+/**
+ * @brief Checks whether a hidraw node belongs to an Apple Pro Display XDR using sysfs.
+ *
+ * Reads the `HID_ID` entry of the parent HID device `uevent` file, which has the form
+ * `HID_ID=<bus>:<vendor>:<product>`, and the `HID_UNIQ` entry holding the serial number.
+ *
+ * @param name[in] The name of the hidraw node (e.g. `hidraw3`).
+ * @param serial[out] The serial number of the display, empty if unknown.
+ * @param serial_size[in] The size of the `serial` buffer.
+ * @return Whether the node vendor and product IDs match that of the Apple Pro Display XDR.
+ */
+static bool sysfs_is_apple_pro_display_xdr_device(const char* name, char* serial,
+                                                  size_t serial_size) {
+  char path[PATH_MAX];
+  char uevent[512];
+
+  snprintf(path, sizeof(path), "%s/%s/device/uevent", SYSFS_HIDRAW_DIRECTORY, name);
+  ssize_t bytes_read = read_file_prefix(path, uevent, sizeof(uevent) - 1);
+  if (bytes_read <= 0) {
+    return false;
+  }
+  uevent[bytes_read] = '\0';
+
+  const char* hid_id = strstr(uevent, "HID_ID=");
+  unsigned int bus, vendor_id, product_id;
+  if (!hid_id || sscanf(hid_id, "HID_ID=%x:%x:%x", &bus, &vendor_id, &product_id) != 3 ||
+      vendor_id != APPLE_INC || product_id != PRO_DISPLAY_XDR) {
+    return false;
+  }
+
+  const char* hid_uniq = strstr(uevent, "HID_UNIQ=");
+  *serial = '\0';
+  if (hid_uniq) {
+    hid_uniq += strlen("HID_UNIQ=");
+    snprintf(serial, serial_size, "%.*s", (int)strcspn(hid_uniq, "\n"), hid_uniq);
+  }
+  return true;
+}
+
+/**
+ * @brief Checks whether a hidraw node is the Apple Pro Display XDR brightness control device using
+ * sysfs.
+ *
+ * Reads the report descriptor exposed by the kernel rather than opening the device node.
+ *
+ * @param name[in] The name of the hidraw node (e.g. `hidraw3`).
+ * @param layout[out] The layout of the brightness reports of the node.
+ * @return Whether the node's report descriptor matches that of the Apple Pro Display XDR brightness
+ *   control device.
+ */
+static bool sysfs_is_apple_pro_display_xdr_brightness_control_device(
+    const char* name, struct brightness_layout* layout) {
+  char path[PATH_MAX];
+  unsigned char descriptor[HID_MAX_DESCRIPTOR_SIZE];
+
+  snprintf(path, sizeof(path), "%s/%s/device/report_descriptor", SYSFS_HIDRAW_DIRECTORY, name);
+  statistics_add(STAT_DESCRIPTOR_FETCHES, 1);
+  ssize_t bytes_read = read_file_prefix(path, descriptor, sizeof(descriptor));
+  if (bytes_read <= 0) {
+    return false;
+  }
+
+  return is_apple_pro_display_xdr_brightness_control_descriptor(descriptor, bytes_read, layout);
+}
+
+/**
+ * @brief Reads the name of the HID device behind a hidraw node (e.g. `0003:05AC:9243.0005`).
+ *
+ * The kernel numbers HID devices in the order they are added and never reuses a name while the
+ * device is connected, so the name identifies the interface, and thus its report descriptor, more
+ * reliably than the hidraw node number.
+ *
+ * @param name[in] The name of the hidraw node (e.g. `hidraw3`).
+ * @param instance[out] The name of the HID device.
+ * @param instance_size[in] The size of the `instance` buffer.
+ * @return Whether the name was read.
+ */
+static bool sysfs_read_device_instance(const char* name, char* instance, size_t instance_size) {
+  char path[PATH_MAX];
+  char target[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/%s/device", SYSFS_HIDRAW_DIRECTORY, name);
+  ssize_t length = readlink(path, target, sizeof(target) - 1);
+  if (length <= 0) {
+    return false;
+  }
+  target[length] = '\0';
+
+  const char* base = strrchr(target, '/');
+  snprintf(instance, instance_size, "%s", base ? base + 1 : target);
+  return true;
+}
+
+/**
+ * @brief Scans sysfs for Apple Pro Display XDR brightness control HID devices.
+ *
+ * Matches vendor, product and report descriptor from the files the kernel exposes under
+ * `/sys/class/hidraw`, without opening any device node. This avoids both the full `hid_enumerate`
+ * and opening each of the 4 interfaces advertised by each display.
+ *
+ * @param displays[out] The displays found, not opened.
+ * @param capacity[in] The capacity of `displays`.
+ * @param count[out] The number of displays found.
+ *
+ * @retval true The scan completed, and `count` holds its result.
+ * @retval false sysfs is unavailable: the caller should fall back to `hid_enumerate`.
+ */
+static bool sysfs_scan_apple_pro_display_xdr_brightness_control_devices(struct display* displays,
+                                                                         size_t capacity,
+                                                                         size_t* count) {
+  DIR* directory = opendir(SYSFS_HIDRAW_DIRECTORY);
+  if (!directory) {
+    return false;
+  }
+
+  *count = 0;
+  for (struct dirent* entry = readdir(directory); entry; entry = readdir(directory)) {
+    char serial[sizeof(displays->serial)];
+    char path[PATH_MAX];
+    struct brightness_layout layout;
+
+    if (strncmp(entry->d_name, "hidraw", strlen("hidraw"))) {
+      continue;
+    }
+
+    statistics_add(STAT_DEVICES_ENUMERATED, 1);
+    uint64_t start_ns = trace_begin();
+    bool found = sysfs_is_apple_pro_display_xdr_device(entry->d_name, serial, sizeof(serial)) &&
+                 sysfs_is_apple_pro_display_xdr_brightness_control_device(entry->d_name, &layout);
+    trace_end("probe", entry->d_name, start_ns);
+    if (!found) {
+      continue;
+    }
+
+    snprintf(path, sizeof(path), "/dev/%s", entry->d_name);
+    if (!append_display(displays, count, capacity, path, serial, &layout, NULL)) {
+      break;
+    }
+  }
+
+  closedir(directory);
+  return true;
+}
+#endif
+
+/**
+ * @brief Scans HID devices for Apple Pro Display XDR brightness control HID devices.
+ *
+ * Iterates over connect HID devices and fetches the report descriptor to find the Apple Pro Display
+ * XDR brightness control HID devices.
+ *
+ * The Pro Display XDR advertises 4 HID interfaces, but only one of them is capable of brightness
+ * control.
+ *
+ * @param displays[out] The displays found, left open.
+ * @param capacity[in] The capacity of `displays`.
+ * @return The number of displays found.
+ * @see README.md
+ */
+static size_t hid_scan_apple_pro_display_xdr_brightness_control_devices(struct display* displays,
+                                                                        size_t capacity) {
+  uint64_t start_ns = trace_begin();
+  struct hid_device_info* devices = hid_enumerate(0x0, 0x0);
+  trace_end("hid_enumerate", NULL, start_ns);
+  size_t count = 0;
+
+  for (struct hid_device_info* it = devices; it; it = it->next) {
+    statistics_add(STAT_DEVICES_ENUMERATED, 1);
+    if (!is_apple_pro_display_xdr_device(it)) {
+      continue;
+    }
+
+    struct device* device = open_device(it->path);
+    if (!device) {
+      report_device_error("failed to open device: %s", it->path);
+      continue;
+    }
+    struct brightness_layout layout;
+    start_ns = trace_begin();
+    bool found = hid_is_apple_pro_display_xdr_brightness_control_device(device, &layout);
+    trace_end("probe", it->path, start_ns);
+    if (!found) {
+      close_device(device);
+      continue;
+    }
+
+    char serial[sizeof(displays->serial)];
+    convert_serial_number(serial, sizeof(serial), it->serial_number);
+    if (!append_display(displays, &count, capacity, it->path, serial, &layout, device)) {
+      close_device(device);
+      break;
+    }
+  }
+
+  hid_free_enumeration(devices);
+  return count;
+}
+
+/**
+ * @brief Orders displays by serial number, then path.
+ *
+ * Serial numbers are stable across reconnections, unlike hidraw node numbers, which keeps display
+ * indices stable too.
+ */
+static int compare_displays(const void* lhs, const void* rhs) {
+  const struct display* left = lhs;
+  const struct display* right = rhs;
+  int order = strcmp(left->serial, right->serial);
+  return order ? order : strcmp(left->path, right->path);
+}
+
+/**
+ * @brief Finds all Apple Pro Display XDR brightness control HID devices.
+ *
+ * On Linux, the scan reads sysfs directly and leaves devices closed. It only uses `hid_enumerate`,
+ * which leaves devices open, if sysfs is not available.
+ *
+ * @param displays[out] The displays found, ordered by serial number.
+ * @param capacity[in] The capacity of `displays`.
+ * @return The number of displays found.
+ */
+size_t scan_displays(struct display* displays, size_t capacity) {
+  size_t count;
+  uint64_t start_ns = trace_begin();
+
+#if defined(HAVE_SYSFS_DISCOVERY)
+  if (!sysfs_scan_apple_pro_display_xdr_brightness_control_devices(displays, capacity, &count))
+#endif
+    count = hid_scan_apple_pro_display_xdr_brightness_control_devices(displays, capacity);
+
+  qsort(displays, count, sizeof(*displays), compare_displays);
+  trace_end("scan_displays", NULL, start_ns);
+  return count;
+}
+
+/**
+ * @brief Builds the name of the device cache file for a display selection.
+ *
+ * Selections by serial number are cached separately from the default selection. Characters that
+ * are not alphanumeric are dropped from the serial number.
+ *
+ * @param selector[in] The display selection.
+ * @param name[out] The name of the cache file.
+ * @param name_size[in] The size of the `name` buffer.
+ */
+static void device_cache_name(const struct display_selector* selector, char* name,
+                              size_t name_size) {
+  size_t length = snprintf(name, name_size, "%s", DEVICE_CACHE_NAME);
+  if (!selector->serial || length + 1 >= name_size) {
+    return;
+  }
+
+  name[length++] = '-';
+  for (const char* it = selector->serial; *it && length + 1 < name_size; ++it) {
+    if (isalnum((unsigned char)*it)) {
+      name[length++] = *it;
+    }
+  }
+  name[length] = '\0';
+}
+
+/**
+ * @brief The brightness control device resolved by a previous invocation.
+ *
+ * @param path The path of the device.
+ * @param descriptor_hash The hash of its report descriptor, or 0 if unknown.
+ * @param enumeration The fingerprint of the connected displays when it was resolved, or 0 if
+ *   irrelevant (see `fingerprint_display_interfaces`).
+ * @param instance The name of its HID device in sysfs, empty if unknown.
+ */
+struct device_cache_entry {
+  char path[PATH_MAX];
+  uint64_t descriptor_hash;
+  uint64_t enumeration;
+  char instance[64];
+};
+
+/**
+ * @brief Reads the brightness control device resolved by a previous invocation.
+ *
+ * The cache file holds the device path on its first line, then the hash of its report descriptor,
+ * the fingerprint of the connected displays and the name of its HID device, if known.
+ *
+ * @param name[in] The name of the cache file.
+ * @param entry[out] The cache entry, if any.
+ *
+ * @retval true A cached path was read into `entry`.
+ * @retval false No usable cache entry.
+ */
+static bool read_device_cache(const char* name, struct device_cache_entry* entry) {
+  char contents[PATH_MAX + 128];
+  if (!read_runtime_file(name, contents, sizeof(contents))) {
+    return false;
+  }
+
+  size_t path_length = strcspn(contents, "\n");
+  if (!path_length || path_length >= sizeof(entry->path)) {
+    return false;
+  }
+  snprintf(entry->path, sizeof(entry->path), "%.*s", (int)path_length, contents);
+
+  entry->descriptor_hash = 0;
+  entry->enumeration = 0;
+  *entry->instance = '\0';
+  if (contents[path_length] == '\n') {
+    sscanf(&contents[path_length + 1], "%" SCNx64 " %" SCNx64 " %63s", &entry->descriptor_hash,
+           &entry->enumeration, entry->instance);
+  }
+  return true;
+}
+
+/**
+ * @brief Records the brightness control device of a display for subsequent invocations.
+ *
+ * @param name[in] The name of the cache file.
+ * @param display[in] The display to cache.
+ * @param enumeration[in] The fingerprint of the connected displays, or 0 if irrelevant.
+ */
+static void write_device_cache(const char* name, const struct display* display,
+                               uint64_t enumeration) {
+  char instance[sizeof(((struct device_cache_entry*)0)->instance)] = "";
+#if defined(HAVE_SYSFS_DISCOVERY)
+  const char* node = strrchr(display->path, '/');
+  if (node && !sysfs_read_device_instance(node + 1, instance, sizeof(instance))) {
+    *instance = '\0';
+  }
+#endif
+
+  char contents[PATH_MAX + 128];
+  snprintf(contents, sizeof(contents), "%s\n%016" PRIx64 " %016" PRIx64 " %s\n", display->path,
+           display->layout.descriptor_hash, enumeration, instance);
+  write_runtime_file(name, contents);
+}
+
+/**
+ * @brief Fingerprints the interfaces of the connected Apple Pro Display XDR.
+ *
+ * Which display the default selection resolves to depends on every connected display, so its
+ * cache entry is only valid while the same interfaces are connected. On Linux, the names of the HID
+ * devices in sysfs (e.g. `0003:05AC:9243.0005`) are listed without reading any file; they change
+ * whenever an interface is reconnected. Elsewhere, `hid_enumerate` lists the paths of the
+ * interfaces, without opening them.
+ *
+ * @return The sum of the FNV-1a hashes of the names of the interfaces, so that their order does not
+ *   matter.
+ */
+static uint64_t fingerprint_display_interfaces(void) {
+  uint64_t fingerprint = 0;
+  uint64_t start_ns = trace_begin();
+
+#if defined(HAVE_SYSFS_DISCOVERY)
+  char model[32];
+  snprintf(model, sizeof(model), ":%04X:%04X.", APPLE_INC, PRO_DISPLAY_XDR);
+  DIR* directory = opendir(SYSFS_HID_DEVICES_DIRECTORY);
+  if (directory) {
+    for (struct dirent* entry = readdir(directory); entry; entry = readdir(directory)) {
+      if (strstr(entry->d_name, model)) {
+        fingerprint += hash_report_descriptor((const unsigned char*)entry->d_name,
+                                              strlen(entry->d_name));
+      }
+    }
+    closedir(directory);
+    trace_end("fingerprint_displays", NULL, start_ns);
+    return fingerprint;
+  }
+#endif
+
+  struct hid_device_info* devices = hid_enumerate(APPLE_INC, PRO_DISPLAY_XDR);
+  for (struct hid_device_info* it = devices; it; it = it->next) {
+    fingerprint += hash_report_descriptor((const unsigned char*)it->path, strlen(it->path));
+  }
+  hid_free_enumeration(devices);
+  trace_end("fingerprint_displays", NULL, start_ns);
+  return fingerprint;
+}
+
+/**
+ * @brief Records the displays found by a full scan for subsequent invocations.
+ *
+ * Each display is cached under its serial number, so that selecting any of them by serial number
+ * skips the scan. The default selection is cached along with the fingerprint of the connected
+ * displays, since which display comes first depends on the others.
+ *
+ * @param displays[in] The displays found by the scan.
+ * @param count[in] The number of displays found.
+ * @param enumeration[in] The fingerprint of the connected displays, taken before the scan.
+ */
+static void write_device_caches(const struct display* displays, size_t count,
+                                uint64_t enumeration) {
+  char cache_name[64];
+  for (size_t i = 0; i < count; ++i) {
+    if (*displays[i].serial) {
+      const struct display_selector selector = {.serial = displays[i].serial, .index = -1};
+      device_cache_name(&selector, cache_name, sizeof(cache_name));
+      write_device_cache(cache_name, &displays[i], /* enumeration= */ 0);
+    }
+  }
+
+  if (count) {
+    write_device_cache(DEVICE_CACHE_NAME, &displays[0], enumeration);
+  } else {
+    char path[PATH_MAX];
+    if (runtime_path(path, sizeof(path), DEVICE_CACHE_NAME, /* create_directory= */ false)) {
+      unlink(path);
+    }
+  }
+}
+
+/**
+ * @brief Checks whether a cached device is still the interface it was resolved to.
+ *
+ * Holds when its HID device kept the same name in sysfs, and the layout of its report descriptor
+ * is cached: its report descriptor then does not need to be fetched again.
+ *
+ * @param entry[in] The cache entry.
+ * @param layout[out] The layout of the brightness reports of the device.
+ * @return Whether the device is known to be a brightness control device.
+ */
+static bool is_unchanged_cached_device(const struct device_cache_entry* entry,
+                                       struct brightness_layout* layout) {
+#if defined(HAVE_SYSFS_DISCOVERY)
+  char instance[sizeof(entry->instance)];
+  const char* node = strrchr(entry->path, '/');
+  bool found;
+  return *entry->instance && node &&
+         sysfs_read_device_instance(node + 1, instance, sizeof(instance)) &&
+         !strcmp(instance, entry->instance) &&
+         read_layout_cache(entry->descriptor_hash, &found, layout) && found;
+#else
+  (void)entry;
+  (void)layout;
+  return false;
+#endif
+}
+
+/**
+ * @brief Reads the serial number of an open display.
+ *
+ * hidraw nodes opened directly read it from sysfs, like the scan does.
+ *
+ * @param display[in,out] The display, whose `serial` is set, empty if unknown.
+ */
+static void read_device_serial(struct display* display) {
+#if defined(HAVE_HIDRAW_BACKEND)
+  if (display->device->fd >= 0) {
+    const char* name = strrchr(display->path, '/') + 1;
+    if (!sysfs_is_apple_pro_display_xdr_device(name, display->serial, sizeof(display->serial))) {
+      *display->serial = '\0';
+    }
+    return;
+  }
+#endif
+
+  wchar_t serial[sizeof(display->serial)];
+  bool read = !hid_get_serial_number_string(display->device->hid, serial,
+                                            sizeof(serial) / sizeof(*serial));
+  convert_serial_number(display->serial, sizeof(display->serial), read ? serial : NULL);
+}
+
+/**
+ * @brief Opens the display cached by a previous invocation with the same selection.
+ *
+ * The cached device is checked with `hid_is_apple_pro_display_xdr_brightness_control_device`, and
+ * against the selected serial number, since hidraw nodes are renumbered when devices come and go.
+ * The report descriptor is not fetched again while the interface stays connected. The default
+ * selection is only served from the cache while the same displays are connected.
+ *
+ * @param selector[in] The display selection, either the default one or by serial number.
+ * @param cache_name[in] The name of the cache file.
+ * @param display[out] The display, opened.
+ * @return Whether the cached display was opened.
+ */
+static bool open_cached_display(const struct display_selector* selector, const char* cache_name,
+                                struct display* display) {
+  struct device_cache_entry entry;
+  uint64_t start_ns = trace_begin();
+  bool cached = read_device_cache(cache_name, &entry);
+  trace_end("read_device_cache", cached ? entry.path : NULL, start_ns);
+  if (!cached) {
+    return false;
+  }
+  uint64_t enumeration = selector->serial ? 0 : fingerprint_display_interfaces();
+  if (enumeration != entry.enumeration) {
+    return false;
+  }
+
+  snprintf(display->path, sizeof(display->path), "%s", entry.path);
+  display->device = open_device(display->path);
+  if (!display->device) {
+    return false;
+  }
+
+  bool unchanged = is_unchanged_cached_device(&entry, &display->layout);
+  if (unchanged || hid_is_apple_pro_display_xdr_brightness_control_device(display->device,
+                                                                           &display->layout)) {
+    display->device->layout = display->layout;
+    read_device_serial(display);
+    if (!selector->serial || !strcmp(selector->serial, display->serial)) {
+      if (!unchanged) {
+        write_device_cache(cache_name, display, enumeration);
+      }
+      return true;
+    }
+  }
+
+  close_device(display->device);
+  display->device = NULL;
+  return false;
+}
+
+/**
+ * @brief Checks whether a display is part of a selection.
+ *
+ * @param selector[in] The display selection.
+ * @param display[in] The display to check.
+ * @param index[in] The index of the display, in serial number order.
+ * @return Whether the display is selected.
+ */
+static bool is_selected(const struct display_selector* selector, const struct display* display,
+                        size_t index) {
+  if (selector->all) {
+    return true;
+  }
+  if (selector->serial) {
+    return !strcmp(selector->serial, display->serial);
+  }
+  return index == (selector->index >= 0 ? (size_t)selector->index : 0);
+}
+
+/**
+ * @brief Finds and opens the selected Apple Pro Display XDR brightness control HID devices.
+ *
+ * Selections of a single display (the default one, or by serial number) try the device path cached
+ * by a previous invocation first, which avoids scanning HID devices. Falls back to a full scan on
+ * cache miss, and updates the cache of every display found.
+ *
+ * @param selector[in] The display selection.
+ * @param displays[out] The selected displays, opened.
+ * @param capacity[in] The capacity of `displays`.
+ * @return The number of displays opened.
+ * @see README.md
+ */
+size_t open_displays(const struct display_selector* selector, struct display* displays,
+                     size_t capacity) {
+  char cache_name[64];
+  bool cached = !selector->all && selector->index < 0;
+
+  if (capacity == 0) {
+    return 0;
+  }
+
+  device_cache_name(selector, cache_name, sizeof(cache_name));
+  if (cached && open_cached_display(selector, cache_name, &displays[0])) {
+    return 1;
+  }
+
+  // Taken before the scan: a display connected meanwhile then invalidates the default cache.
+  uint64_t enumeration = fingerprint_display_interfaces();
+  struct display found[MAX_DISPLAYS];
+  size_t found_count = scan_displays(found, MAX_DISPLAYS);
+  size_t count = 0;
+
+  for (size_t i = 0; i < found_count; ++i) {
+    if (!is_selected(selector, &found[i], i) || count == capacity) {
+      if (found[i].device) {
+        close_device(found[i].device);
+      }
+      continue;
+    }
+
+    if (!found[i].device && !open_display_device(&found[i])) {
+      report_device_error("failed to open device: %s", found[i].path);
+      continue;
+    }
+    displays[count++] = found[i];
+  }
+
+  write_device_caches(found, found_count, enumeration);
+  return count;
+}
+
+/**
+ * @brief Opens the display behind a hidraw node that was just added, if it is selected.
+ *
+ * Probes the added node alone, rather than scanning every HID device. Selections by index depend
+ * on the other displays, and fall back to `open_displays`, as do systems without sysfs.
+ *
+ * @param node[in] The path of the added node, e.g. `/dev/hidraw3`.
+ * @param selector[in] The display selection, of a single display.
+ * @param display[out] The display, opened.
+ * @return Whether the node is the brightness control device of the selected display, and was
+ *   opened.
+ * @see hotplug_receive
+ */
+bool open_added_display(const char* node, const struct display_selector* selector,
+                        struct display* display) {
+#if defined(HAVE_SYSFS_DISCOVERY)
+  if (selector->index < 0) {
+    const char* name = strrchr(node, '/');
+    name = name ? name + 1 : node;
+
+    uint64_t start_ns = trace_begin();
+    bool found = sysfs_is_apple_pro_display_xdr_device(name, display->serial,
+                                                       sizeof(display->serial)) &&
+                 sysfs_is_apple_pro_display_xdr_brightness_control_device(name, &display->layout);
+    trace_end("probe", name, start_ns);
+    if (!found || (selector->serial && strcmp(selector->serial, display->serial))) {
+      return false;
+    }
+
+    snprintf(display->path, sizeof(display->path), "%s", node);
+    return open_display_device(display);
+  }
+#else
+  (void)node;
+#endif
+  return open_displays(selector, display, 1) == 1;
+}
+
+/**
+ * @brief Closes displays opened with `open_displays`.
+ *
+ * @param displays[in,out] The displays to close.
+ * @param count[in] The number of displays.
+ */
+void close_displays(struct display* displays, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (displays[i].device) {
+      uint64_t start_ns = trace_begin();
+      close_device(displays[i].device);
+      trace_end("close_device", displays[i].path, start_ns);
+      displays[i].device = NULL;
+    }
+  }
+}
+
+/**
+ * @brief Reads a little-endian brightness value from a report.
+ *
+ * @param data[in] The first byte of the value.
+ * @param size[in] The size of the value, in bytes.
+ * @return The value.
+ */
+static uint32_t read_brightness_value(const unsigned char* data, size_t size) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < size; ++i) {
+    value |= (uint32_t)data[i] << (8 * i);
+  }
+  return value;
+}
+
+/**
+ * @brief Fetches a HID feature report to get the brightness value.
+ *
+ * The report is laid out as its report descriptor declares, see README.md for the documented
+ * layout.
+ *
+ * @param device[in] The HID device to fetch the report from.
+ *
+ * @retval >=0 The absolute brightness value.
+ * @retval -1 Failed to fetch HID report.
+ */
+int32_t hid_get_brightness(struct device* device) {
+  const struct brightness_layout* layout = &device->layout;
+  unsigned char report[BRIGHTNESS_REPORT_MAX_LENGTH] = {layout->report_id};
+
+  uint64_t start_ns = trace_begin();
+  int bytes_read;
+#if defined(HAVE_HIDRAW_BACKEND)
+  if (device->fd >= 0) {
+    bytes_read = hidraw_get_feature_report(device->fd, report, layout->feature_length);
+  } else
+#endif
+    bytes_read = hid_get_feature_report(device->hid, report, layout->feature_length);
+  trace_end("get_feature_report", NULL, start_ns);
+
+  if (bytes_read < 0) {
+    report_hid_error(device, "failed to retrieve feature report");
+    return -1;
+  }
+  statistics_add(STAT_FEATURE_REPORTS_RECEIVED, 1);
+  statistics_add(STAT_BYTES_RECEIVED, bytes_read);
+
+  if ((size_t)bytes_read < (size_t)layout->feature_offset + layout->size) {
+    report_device_error("feature report too short: %d bytes", bytes_read);
+    return -1;
+  }
+  return read_brightness_value(&report[layout->feature_offset], layout->size);
+}
+
+/**
+ * @brief Sends a HID feature report to update the brightness value.
+ *
+ * Parameter must be a valid absolute value (i.e. in [BRIGHTNESS_MIN, BRIGHTNESS_MAX]). The other
+ * fields of the report are left at 0.
+ *
+ * @param device[in] The HID device to send the report to.
+ * @param brightness[in] The absolute brightness value to request.
+ *
+ * @retval true HID report sent successfully.
+ * @retval false Failed to send HID report.
+ */
+bool hid_set_brightness(struct device* device, uint32_t brightness) {
+  assert(brightness >= BRIGHTNESS_MIN && brightness <= BRIGHTNESS_MAX);
+
+  const struct brightness_layout* layout = &device->layout;
+  unsigned char report[BRIGHTNESS_REPORT_MAX_LENGTH] = {layout->report_id};
+  for (size_t i = 0; i < layout->size; ++i) {
+    report[layout->feature_offset + i] = brightness >> (8 * i) & 0xff;
+  }
+
+  uint64_t start_ns = trace_begin();
+  int bytes_written;
+#if defined(HAVE_HIDRAW_BACKEND)
+  if (device->fd >= 0) {
+    bytes_written = hidraw_send_feature_report(device->fd, report, layout->feature_length);
+  } else
+#endif
+    bytes_written = hid_send_feature_report(device->hid, report, layout->feature_length);
+  trace_end("send_feature_report", NULL, start_ns);
+
+  if (bytes_written < 0) {
+    report_hid_error(device, "failed to send feature report");
+    return false;
+  }
+  statistics_add(STAT_FEATURE_REPORTS_SENT, 1);
+  statistics_add(STAT_BYTES_SENT, bytes_written);
+
+  return true;
+}
+
+/**
+ * @brief Extracts the brightness from an input report.
+ *
+ * @param layout[in] The layout of the brightness reports.
+ * @param report[in] The input report, starting with its report ID if the device uses them.
+ * @param length[in] The length of the report.
+ * @return The absolute brightness value, or -1 if the report does not carry it.
+ */
+static int32_t parse_input_report(const struct brightness_layout* layout,
+                                  const unsigned char* report, size_t length) {
+  if (!layout->input_length || length < (size_t)layout->input_offset + layout->size ||
+      (layout->report_id && report[0] != layout->report_id)) {
+    return -1;
+  }
+  return read_brightness_value(&report[layout->input_offset], layout->size);
+}
+
+/**
+ * @brief Waits for a HID input report carrying the brightness value.
+ *
+ * The display sends this report whenever its brightness changes. Input reports with another report
+ * ID are skipped, without extending the wait.
+ *
+ * @param device[in] The HID device to read the report from.
+ * @param timeout_ms[in] The maximum time to wait in milliseconds, or -1 to wait indefinitely.
+ *
+ * @retval >=0 The absolute brightness value.
+ * @retval -1 Failed to read HID report.
+ * @retval BRIGHTNESS_TIMED_OUT No report received within `timeout_ms`.
+ */
+int32_t hid_read_brightness(struct device* device, int timeout_ms) {
+  const struct brightness_layout* layout = &device->layout;
+  // Large enough for any report the interface may send.
+  unsigned char buffer[BRIGHTNESS_REPORT_MAX_LENGTH];
+  // Other reports must not extend the wait: it ends at the same deadline however many arrive.
+  uint64_t deadline_ns = monotonic_ns() + (timeout_ms > 0 ? timeout_ms : 0) * 1000000ull;
+
+  for (bool first = true;; first = false) {
+    int remaining_ms = timeout_ms;
+    if (timeout_ms >= 0) {
+      uint64_t now_ns = monotonic_ns();
+      remaining_ms = now_ns < deadline_ns ? (int)((deadline_ns - now_ns + 999999) / 1000000) : 0;
+      if (!remaining_ms && !first) {
+        return BRIGHTNESS_TIMED_OUT;
+      }
+    }
+
+    int bytes_read;
+#if defined(HAVE_HIDRAW_BACKEND)
+    if (device->fd >= 0) {
+      bytes_read = hidraw_read_timeout(device->fd, buffer, sizeof(buffer), remaining_ms);
+    } else
+#endif
+      bytes_read = hid_read_timeout(device->hid, buffer, sizeof(buffer), remaining_ms);
+    if (bytes_read < 0) {
+      report_hid_error(device, "failed to read input report");
+      return -1;
+    }
+    if (bytes_read == 0) {
+      return BRIGHTNESS_TIMED_OUT;
+    }
+    statistics_add(STAT_INPUT_REPORTS_RECEIVED, 1);
+    statistics_add(STAT_BYTES_RECEIVED, bytes_read);
+
+    int32_t brightness = parse_input_report(layout, buffer, bytes_read);
+    if (brightness >= 0) {
+      return brightness;
+    }
+  }
+}
+
+/**
+ * @brief Reads the input reports already received on the handle of a device, without waiting.
+ *
+ * Lets a long-lived process follow the brightness of a display on any backend, including those
+ * without a separate handle for input reports (see `open_input_reports`). Input reports are only
+ * buffered up to a limit, past which the most recent ones may be dropped: finding that many
+ * reports pending is reported as a failure, since the last one read may not be current.
+ *
+ * @param device[in] The HID device.
+ *
+ * @retval >=0 The absolute brightness value carried by the most recent brightness report.
+ * @retval -1 Failed to read, or too many reports were pending to trust the most recent one.
+ * @retval BRIGHTNESS_TIMED_OUT No brightness report was pending.
+ */
+int32_t drain_input_brightness(struct device* device) {
+  int32_t brightness = BRIGHTNESS_TIMED_OUT;
+  for (unsigned int i = 0; i < INPUT_DRAIN_LIMIT; ++i) {
+    int32_t value = hid_read_brightness(device, /* timeout_ms= */ 0);
+    if (value == BRIGHTNESS_TIMED_OUT) {
+      return brightness;
+    }
+    if (value < 0) {
+      return -1;
+    }
+    brightness = value;
+  }
+  return -1;
+}
+
+/**
+ * @brief Opens a second handle on a display, readable when the display sends an input report.
+ *
+ * Lets an event loop wait for brightness changes along with other file descriptors, while the
+ * device of the display keeps serving feature reports. Each handle receives its own copy of the
+ * input reports.
+ *
+ * @param display[in] The display, whose device is a hidraw node.
+ * @return A non-blocking file descriptor to read with `read_input_brightness`, or -1 if the device
+ *   is not a hidraw node.
+ */
+int open_input_reports(const struct display* display) {
+#if defined(HAVE_SYSFS_DISCOVERY)
+  if (!strncmp(display->path, HIDRAW_DEVICE_PREFIX, strlen(HIDRAW_DEVICE_PREFIX))) {
+    return open(display->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  }
+#else
+  (void)display;
+#endif
+  return -1;
+}
+
+/**
+ * @brief Reads the input reports received on a handle opened with `open_input_reports`.
+ *
+ * @param fd[in] The handle.
+ * @param layout[in] The layout of the brightness reports of the display.
+ *
+ * @retval >=0 The absolute brightness value carried by the most recent brightness report.
+ * @retval -1 Failed to read, e.g. the display was disconnected.
+ * @retval BRIGHTNESS_TIMED_OUT No brightness report was pending.
+ */
+int32_t read_input_brightness(int fd, const struct brightness_layout* layout) {
+  unsigned char buffer[BRIGHTNESS_REPORT_MAX_LENGTH];
+  int32_t brightness = BRIGHTNESS_TIMED_OUT;
+
+  for (;;) {
+    ssize_t bytes_read = read(fd, buffer, sizeof(buffer));
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return brightness;
+    }
+    if (bytes_read <= 0) {
+      return -1;
+    }
+    statistics_add(STAT_INPUT_REPORTS_RECEIVED, 1);
+    statistics_add(STAT_BYTES_RECEIVED, bytes_read);
+
+    int32_t value = parse_input_report(layout, buffer, bytes_read);
+    if (value >= 0) {
+      brightness = value;
+    }
+  }
+}
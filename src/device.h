@@ -0,0 +1,101 @@
+#ifndef APDBCTL_DEVICE_H
+#define APDBCTL_DEVICE_H
+
+#include <hidapi.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_DISPLAYS 8
+#define BRIGHTNESS_TIMED_OUT -2
+
+extern bool device_errors_printed;
+
+/**
+ * @brief An open HID device, through hidapi or the hidraw ioctls.
+ */
+struct device;
+
+/**
+ * @brief Where the brightness is in the reports of a brightness control device.
+ *
+ * Extracted from the report descriptor, see `parse_report_descriptor`. Reports are transferred
+ * with their report ID, or 0 if the device does not use report IDs, as their first byte.
+ *
+ * @param descriptor_hash The hash of the report descriptor the layout was extracted from.
+ * @param report_id The ID of the brightness reports.
+ * @param size The size of the brightness value, in bytes. It is encoded in little-endian.
+ * @param feature_length The length of the feature report, including its first byte.
+ * @param feature_offset The offset of the brightness value in the feature report.
+ * @param input_length The length of the input report, or 0 if the device does not send it.
+ * @param input_offset The offset of the brightness value in the input report.
+ * @param minimum The logical minimum of the brightness.
+ * @param maximum The logical maximum of the brightness.
+ * @param unit The unit of the brightness, as encoded in the descriptor.
+ * @param unit_exponent The base 10 exponent of the unit.
+ */
+struct brightness_layout {
+  uint64_t descriptor_hash;
+  uint8_t report_id;
+  uint8_t size;
+  uint8_t feature_length;
+  uint8_t feature_offset;
+  uint8_t input_length;
+  uint8_t input_offset;
+  int32_t minimum;
+  int32_t maximum;
+  uint32_t unit;
+  int8_t unit_exponent;
+};
+
+/**
+ * @brief The brightness control device of an Apple Pro Display XDR.
+ *
+ * @param path The path of the HID device.
+ * @param serial The serial number of the display, empty if unknown.
+ * @param layout The layout of the brightness reports.
+ * @param device The open device, or NULL if not open.
+ */
+struct display {
+  char path[PATH_MAX];
+  char serial[64];
+  struct brightness_layout layout;
+  struct device* device;
+};
+
+/**
+ * @brief Selects the displays to operate on.
+ *
+ * Without any criteria, the first display is selected.
+ *
+ * @param all Whether to select all displays.
+ * @param serial The serial number of the display to select, or NULL.
+ * @param index The index of the display to select in serial number order, or -1.
+ */
+struct display_selector {
+  bool all;
+  const char* serial;
+  int index;
+};
+
+size_t scan_displays(struct display* displays, size_t capacity);
+size_t open_displays(const struct display_selector* selector, struct display* displays,
+                     size_t capacity);
+bool open_added_display(const char* node, const struct display_selector* selector,
+                        struct display* display);
+void close_displays(struct display* displays, size_t count);
+
+const char* device_last_error(void);
+bool select_device_backend(const char* name);
+struct device* open_device(const char* path);
+void close_device(struct device* device);
+
+int32_t hid_get_brightness(struct device* device);
+bool hid_set_brightness(struct device* device, uint32_t brightness);
+int32_t hid_read_brightness(struct device* device, int timeout_ms);
+int32_t drain_input_brightness(struct device* device);
+int open_input_reports(const struct display* display);
+int32_t read_input_brightness(int fd, const struct brightness_layout* layout);
+
+#endif  // APDBCTL_DEVICE_H
@@ -0,0 +1,187 @@
+#include "fade.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "brightness.h"
+#include "clock.h"
+#include "device.h"
+
+// 100 Hz: smooth to the eye, and well within what the USB control pipe sustains.
+#define FADE_STEP_PERIOD_NS 10000000ull
+
+/**
+ * @brief Parses the input string as a fade curve.
+ *
+ * @param parameter[in] The string to parse: "linear", "ease" or "perceptual".
+ * @param curve[out] The parsed curve, if successful.
+ *
+ * @retval true Parsing successful.
+ * @retval false Unknown curve.
+ */
+bool parse_fade_curve(const char* parameter, enum fade_curve* curve) {
+  if (!strcmp(parameter, "linear")) {
+    *curve = FADE_CURVE_LINEAR;
+  } else if (!strcmp(parameter, "ease")) {
+    *curve = FADE_CURVE_EASE;
+  } else if (!strcmp(parameter, "perceptual")) {
+    *curve = FADE_CURVE_PERCEPTUAL;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Converts a relative luminance into CIE 1976 lightness (L*).
+ *
+ * @param luminance[in] The relative luminance, in [0, 1].
+ * @return The lightness, in [0, 100].
+ */
+static double to_lightness(double luminance) {
+  return luminance > 216.0 / 24389.0 ? 116.0 * cbrt(luminance) - 16.0
+                                     : luminance * 24389.0 / 27.0;
+}
+
+/**
+ * @brief Converts a CIE 1976 lightness (L*) into relative luminance.
+ *
+ * @param lightness[in] The lightness, in [0, 100].
+ * @return The relative luminance, in [0, 1].
+ */
+static double to_luminance(double lightness) {
+  return lightness > 8.0 ? pow((lightness + 16.0) / 116.0, 3.0) : lightness * 27.0 / 24389.0;
+}
+
+/**
+ * @brief Computes the brightness at a given point of a fade.
+ *
+ * @param from[in] The absolute brightness at the start of the fade.
+ * @param to[in] The absolute brightness at the end of the fade.
+ * @param progress[in] The progress of the fade, in [0, 1].
+ * @param curve[in] The interpolation curve.
+ * @return The absolute brightness value (in [BRIGHTNESS_MIN, BRIGHTNESS_MAX]).
+ */
+static uint32_t fade_interpolate(uint32_t from, uint32_t to, double progress,
+                                 enum fade_curve curve) {
+  double value;
+
+  switch (curve) {
+    case FADE_CURVE_EASE:
+      progress = progress * progress * (3.0 - 2.0 * progress);
+      // Fall through.
+    case FADE_CURVE_LINEAR:
+      value = from + ((double)to - from) * progress;
+      break;
+    case FADE_CURVE_PERCEPTUAL: {
+      // Interpolate lightness rather than luminance so that each step looks equally large.
+      double start = to_lightness((double)from / BRIGHTNESS_MAX);
+      double end = to_lightness((double)to / BRIGHTNESS_MAX);
+      value = to_luminance(start + (end - start) * progress) * BRIGHTNESS_MAX;
+      break;
+    }
+  }
+
+  value = round(value);
+  if (value < BRIGHTNESS_MIN) return BRIGHTNESS_MIN;
+  if (value > BRIGHTNESS_MAX) return BRIGHTNESS_MAX;
+  return (uint32_t)value;
+}
+
+/**
+ * @brief Gradually changes the brightness of the device.
+ *
+ * Steps are paced against absolute deadlines of the monotonic clock, so that wake-up latency does
+ * not accumulate over the fade. When the device falls behind (e.g. a slow feature report), the
+ * steps whose deadline already passed are dropped rather than replayed late.
+ *
+ * @param device[in] The HID device to send reports to.
+ * @param from[in] The absolute brightness at the start of the fade.
+ * @param to[in] The absolute brightness at the end of the fade.
+ * @param start_ns[in] The time to start the fade at on the monotonic clock, or 0 to start now.
+ *   Fades sharing a start time stay in step with each other.
+ * @param duration_ns[in] The duration of the fade, in nanoseconds.
+ * @param curve[in] The interpolation curve.
+ * @param statistics[out] Pacing statistics of the fade.
+ *
+ * @retval true Fade completed.
+ * @retval false Failed to send HID report.
+ */
+bool fade_brightness(struct device* device, uint32_t from, uint32_t to, uint64_t start_ns,
+                     uint64_t duration_ns, enum fade_curve curve,
+                     struct fade_statistics* statistics) {
+  *statistics = (struct fade_statistics){0};
+
+  if (!start_ns) {
+    start_ns = monotonic_ns();
+  }
+  // Keeps the deadline of the last step representable, for durations of centuries.
+  if (duration_ns > UINT64_MAX - start_ns) {
+    duration_ns = UINT64_MAX - start_ns;
+  }
+
+  // Fades longer than UINT32_MAX periods (over a year) take longer steps, rather than wrapping the
+  // step count around.
+  uint64_t steps = duration_ns / FADE_STEP_PERIOD_NS;
+  if (steps == 0) {
+    steps = 1;
+  } else if (steps > UINT32_MAX) {
+    steps = UINT32_MAX;
+  }
+  uint64_t period_ns = duration_ns / steps;
+  statistics->steps = (uint32_t)steps;
+  uint32_t current = from;
+
+  for (uint64_t step = 1; step <= steps; ++step) {
+    uint64_t deadline_ns = start_ns + step * period_ns;
+    sleep_until(deadline_ns);
+    uint64_t now_ns = monotonic_ns();
+
+    // Jump to the latest step that is due.
+    if (period_ns) {
+      uint64_t due = (now_ns - start_ns) / period_ns;
+      if (due > steps) {
+        due = steps;
+      }
+      if (due > step) {
+        statistics->steps_dropped += due - step;
+        step = due;
+        deadline_ns = start_ns + step * period_ns;
+      }
+    }
+
+    if (now_ns - deadline_ns > statistics->max_jitter_ns) {
+      statistics->max_jitter_ns = now_ns - deadline_ns;
+    }
+
+    uint32_t brightness = fade_interpolate(from, to, (double)step / steps, curve);
+    if (brightness == current) {
+      continue;
+    }
+    if (!statistics->steps_sent) {
+      statistics->first_report_ns = monotonic_ns();
+    }
+    if (!hid_set_brightness(device, brightness)) {
+      return false;
+    }
+    current = brightness;
+    ++statistics->steps_sent;
+  }
+
+  statistics->elapsed_ns = monotonic_ns() - start_ns;
+  return true;
+}
+
+/**
+ * @brief Prints fade statistics on standard error.
+ *
+ * @param statistics[in] The statistics to print.
+ */
+void print_fade_statistics(const struct fade_statistics* statistics) {
+  double elapsed = (double)statistics->elapsed_ns / NANOSECONDS_PER_SECOND;
+  fprintf(stderr, "fade: %u/%u steps sent, %u dropped, %.3fs, %.1f steps/s, max jitter %.3fms\n",
+          statistics->steps_sent, statistics->steps, statistics->steps_dropped, elapsed,
+          elapsed > 0 ? statistics->steps_sent / elapsed : 0.0,
+          (double)statistics->max_jitter_ns / 1e6);
+}
@@ -0,0 +1,40 @@
+#ifndef APDBCTL_FADE_H
+#define APDBCTL_FADE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device.h"
+
+enum fade_curve {
+  FADE_CURVE_LINEAR,
+  FADE_CURVE_EASE,
+  FADE_CURVE_PERCEPTUAL,
+};
+
+/**
+ * @brief Statistics collected while running a fade.
+ *
+ * @param steps The number of steps the fade was divided into.
+ * @param steps_sent The number of feature reports sent.
+ * @param steps_dropped The number of steps skipped because the device fell behind schedule.
+ * @param elapsed_ns The duration of the fade, in nanoseconds.
+ * @param max_jitter_ns The largest delay between a step deadline and its execution.
+ * @param first_report_ns The time the first feature report was sent, on the monotonic clock.
+ */
+struct fade_statistics {
+  uint32_t steps;
+  uint32_t steps_sent;
+  uint32_t steps_dropped;
+  uint64_t elapsed_ns;
+  uint64_t max_jitter_ns;
+  uint64_t first_report_ns;
+};
+
+bool parse_fade_curve(const char* parameter, enum fade_curve* curve);
+bool fade_brightness(struct device* device, uint32_t from, uint32_t to, uint64_t start_ns,
+                     uint64_t duration_ns, enum fade_curve curve,
+                     struct fade_statistics* statistics);
+void print_fade_statistics(const struct fade_statistics* statistics);
+
+#endif  // APDBCTL_FADE_H
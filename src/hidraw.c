@@ -0,0 +1,98 @@
+#include "hidraw.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/hidraw.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/**
+ * @brief Opens a hidraw device node for reading and writing reports.
+ *
+ * @param path[in] The path of the device node, e.g. `/dev/hidraw3`.
+ * @return The file descriptor of the node, or -1 with `errno` set.
+ */
+int hidraw_open(const char* path) {
+  return open(path, O_RDWR | O_CLOEXEC);
+}
+
+/**
+ * @brief Fetches the beginning of the report descriptor of a hidraw node.
+ *
+ * @param fd[in] The hidraw node.
+ * @param buffer[out] The buffer to copy the descriptor to.
+ * @param size[in] The size of `buffer`.
+ * @return The number of bytes copied, or -1 with `errno` set.
+ */
+int hidraw_get_report_descriptor(int fd, unsigned char* buffer, size_t size) {
+  struct hidraw_report_descriptor descriptor;
+
+  if (ioctl(fd, HIDIOCGRDESCSIZE, &descriptor.size) < 0) {
+    return -1;
+  }
+  if (ioctl(fd, HIDIOCGRDESC, &descriptor) < 0) {
+    return -1;
+  }
+
+  size_t length = descriptor.size < size ? descriptor.size : size;
+  memcpy(buffer, descriptor.value, length);
+  return length;
+}
+
+/**
+ * @brief Fetches a feature report, with the same conventions as `hid_get_feature_report`.
+ *
+ * @param fd[in] The hidraw node.
+ * @param data[in,out] The report ID in the first byte, replaced by the report.
+ * @param length[in] The size of `data`, including the report ID.
+ * @return The number of bytes read, including the report ID, or -1 with `errno` set.
+ */
+int hidraw_get_feature_report(int fd, unsigned char* data, size_t length) {
+  return ioctl(fd, HIDIOCGFEATURE(length), data);
+}
+
+/**
+ * @brief Sends a feature report, with the same conventions as `hid_send_feature_report`.
+ *
+ * @param fd[in] The hidraw node.
+ * @param data[in] The report, starting with the report ID.
+ * @param length[in] The size of `data`, including the report ID.
+ * @return The number of bytes written, or -1 with `errno` set.
+ */
+int hidraw_send_feature_report(int fd, const unsigned char* data, size_t length) {
+  return ioctl(fd, HIDIOCSFEATURE(length), data);
+}
+
+/**
+ * @brief Waits for an input report, with the same conventions as `hid_read_timeout`.
+ *
+ * @param fd[in] The hidraw node.
+ * @param data[out] The report, starting with the report ID.
+ * @param length[in] The size of `data`.
+ * @param timeout_ms[in] The maximum time to wait in milliseconds, or -1 to wait indefinitely.
+ * @return The number of bytes read, 0 on timeout, or -1 with `errno` set.
+ */
+int hidraw_read_timeout(int fd, unsigned char* data, size_t length, int timeout_ms) {
+  struct pollfd descriptor = {.fd = fd, .events = POLLIN};
+
+  int ready;
+  do {
+    ready = poll(&descriptor, 1, timeout_ms);
+  } while (ready < 0 && errno == EINTR);
+
+  if (ready <= 0) {
+    return ready;
+  }
+  if (descriptor.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    errno = ENODEV;
+    return -1;
+  }
+
+  ssize_t bytes_read;
+  do {
+    bytes_read = read(fd, data, length);
+  } while (bytes_read < 0 && errno == EINTR);
+  return bytes_read;
+}
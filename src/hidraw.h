@@ -0,0 +1,12 @@
+#ifndef APDBCTL_HIDRAW_H
+#define APDBCTL_HIDRAW_H
+
+#include <stddef.h>
+
+int hidraw_open(const char* path);
+int hidraw_get_report_descriptor(int fd, unsigned char* buffer, size_t size);
+int hidraw_get_feature_report(int fd, unsigned char* data, size_t length);
+int hidraw_send_feature_report(int fd, const unsigned char* data, size_t length);
+int hidraw_read_timeout(int fd, unsigned char* data, size_t length, int timeout_ms);
+
+#endif  // APDBCTL_HIDRAW_H
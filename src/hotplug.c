@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+
+#include "hotplug.h"
+
+#include <stdio.h>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#define APPLE_INC 0x05ac
+#define PRO_DISPLAY_XDR 0x9243
+
+// Multicast groups of the uevent socket: as sent by the kernel, and as relayed by udev once its
+// rules (e.g. the permissions of the node) were applied.
+#define UEVENT_GROUP_KERNEL 1
+#define UEVENT_GROUP_UDEV 2
+
+#define UDEV_MONITOR_PREFIX "libudev"
+#define UDEV_MONITOR_MAGIC 0xfeedcafe
+#define UEVENT_BUFFER_SIZE 8192
+
+/**
+ * @brief The header of the messages relayed by udev, see `monitor_netlink_header` in systemd.
+ */
+struct udev_monitor_header {
+  char prefix[8];
+  uint32_t magic;
+  uint32_t header_size;
+  uint32_t properties_offset;
+  uint32_t properties_length;
+};
+
+/**
+ * @brief Checks whether a sysfs device path is a hidraw node of an Apple Pro Display XDR.
+ *
+ * The path ends with the name of the parent HID device, which holds the vendor and product IDs:
+ * `/devices/.../0003:05AC:9243.0005/hidraw/hidraw3`. It is checked from the path rather than from
+ * sysfs, which no longer has the node once it is removed.
+ *
+ * @param path[in] The value of the `DEVPATH` property.
+ * @return Whether the node belongs to an Apple Pro Display XDR.
+ */
+static bool is_apple_pro_display_xdr_node(const char* path) {
+  const char* hidraw = strstr(path, "/hidraw/");
+  if (!hidraw) {
+    return false;
+  }
+
+  const char* parent = hidraw;
+  while (parent > path && parent[-1] != '/') {
+    --parent;
+  }
+
+  unsigned int bus, vendor_id, product_id;
+  return sscanf(parent, "%x:%x:%x.", &bus, &vendor_id, &product_id) == 3 &&
+         vendor_id == APPLE_INC && product_id == PRO_DISPLAY_XDR;
+}
+
+/**
+ * @brief Parses a uevent message into an event, if it is about an Apple Pro Display XDR node.
+ *
+ * Kernel messages start with an `<action>@<path>` line, udev messages with a binary header; both
+ * continue with NUL-separated `KEY=value` properties.
+ *
+ * @param message[in] The message, NUL-terminated.
+ * @param length[in] The length of the message.
+ * @param event[out] The event.
+ * @return Whether the message is about an Apple Pro Display XDR node being added or removed.
+ */
+static bool parse_uevent(const char* message, size_t length, struct hotplug_event* event) {
+  const char* properties = message;
+  const char* end = message + length;
+
+  if (length >= sizeof(struct udev_monitor_header) &&
+      !memcmp(message, UDEV_MONITOR_PREFIX, sizeof(UDEV_MONITOR_PREFIX))) {
+    struct udev_monitor_header header;
+    memcpy(&header, message, sizeof(header));
+    if (ntohl(header.magic) != UDEV_MONITOR_MAGIC || header.properties_offset > length ||
+        header.properties_length > length - header.properties_offset) {
+      return false;
+    }
+    properties = message + header.properties_offset;
+    end = properties + header.properties_length;
+  } else if (strchr(message, '@')) {
+    properties = message + strlen(message) + 1;
+  } else {
+    return false;
+  }
+
+  const char* action = NULL;
+  const char* subsystem = NULL;
+  const char* path = NULL;
+  const char* name = NULL;
+  for (const char* property = properties; property < end; property += strlen(property) + 1) {
+    if (!strncmp(property, "ACTION=", strlen("ACTION="))) {
+      action = property + strlen("ACTION=");
+    } else if (!strncmp(property, "SUBSYSTEM=", strlen("SUBSYSTEM="))) {
+      subsystem = property + strlen("SUBSYSTEM=");
+    } else if (!strncmp(property, "DEVPATH=", strlen("DEVPATH="))) {
+      path = property + strlen("DEVPATH=");
+    } else if (!strncmp(property, "DEVNAME=", strlen("DEVNAME="))) {
+      name = property + strlen("DEVNAME=");
+    }
+  }
+
+  if (!action || !subsystem || !path || !name || strcmp(subsystem, "hidraw") ||
+      !is_apple_pro_display_xdr_node(path)) {
+    return false;
+  }
+  // A change (e.g. from `udevadm trigger`) may have made an existing node accessible.
+  if (!strcmp(action, "add") || !strcmp(action, "change")) {
+    event->action = HOTPLUG_ADD;
+  } else if (!strcmp(action, "remove")) {
+    event->action = HOTPLUG_REMOVE;
+  } else {
+    return false;
+  }
+
+  // The kernel names the node relative to /dev, udev gives its full path.
+  snprintf(event->node, sizeof(event->node), "%s%s", *name == '/' ? "" : "/dev/", name);
+  return true;
+}
+#endif
+
+/**
+ * @brief Subscribes to the addition and removal of hidraw nodes.
+ *
+ * Listens to the uevents broadcast by the kernel and relayed by udev on a netlink socket, which
+ * only becomes readable when a device is added or removed: there is no polling while nothing
+ * changes. Events are hints, to be confirmed by probing the node: without udev, a node may still
+ * have the default permissions when the kernel announces it, and udev announces it again once its
+ * rules were applied.
+ *
+ * @return A non-blocking socket to poll and pass to `hotplug_receive`, or -1 if uevents are not
+ *   available (e.g. on other systems than Linux).
+ */
+int hotplug_open(void) {
+#if defined(__linux__)
+  int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct sockaddr_nl address = {
+      .nl_family = AF_NETLINK,
+      .nl_groups = UEVENT_GROUP_KERNEL | UEVENT_GROUP_UDEV,
+  };
+  int enabled = 1;
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &enabled, sizeof(enabled)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+#else
+  return -1;
+#endif
+}
+
+/**
+ * @brief Receives the next event about an Apple Pro Display XDR node, without blocking.
+ *
+ * Other devices' events are skipped, as are messages not sent by the kernel or a process running
+ * as root, since any process may send to the udev group.
+ *
+ * @param fd[in] The socket returned by `hotplug_open`.
+ * @param event[out] The event.
+ *
+ * @retval 1 `event` holds the next event.
+ * @retval 0 No event is pending.
+ * @retval -1 Events were lost (e.g. the socket buffer overflowed): displays must be scanned again.
+ */
+int hotplug_receive(int fd, struct hotplug_event* event) {
+#if defined(__linux__)
+  for (;;) {
+    char message[UEVENT_BUFFER_SIZE + 1];
+    char control[CMSG_SPACE(sizeof(struct ucred))];
+    struct sockaddr_nl sender;
+    struct iovec buffer = {.iov_base = message, .iov_len = UEVENT_BUFFER_SIZE};
+    struct msghdr header = {
+        .msg_name = &sender,
+        .msg_namelen = sizeof(sender),
+        .msg_iov = &buffer,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+
+    ssize_t length = recvmsg(fd, &header, 0);
+    if (length < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    message[length] = '\0';
+
+    struct cmsghdr* credentials = CMSG_FIRSTHDR(&header);
+    if (!credentials || credentials->cmsg_type != SCM_CREDENTIALS) {
+      continue;
+    }
+    struct ucred sender_credentials;
+    memcpy(&sender_credentials, CMSG_DATA(credentials), sizeof(sender_credentials));
+    if (sender_credentials.uid != 0 || (header.msg_flags & MSG_TRUNC)) {
+      continue;
+    }
+
+    if (parse_uevent(message, length, event)) {
+      return 1;
+    }
+  }
+#else
+  (void)fd;
+  (void)event;
+  return 0;
+#endif
+}
@@ -0,0 +1,25 @@
+#ifndef APDBCTL_HOTPLUG_H
+#define APDBCTL_HOTPLUG_H
+
+#include <limits.h>
+
+enum hotplug_action {
+  HOTPLUG_ADD,
+  HOTPLUG_REMOVE,
+};
+
+/**
+ * @brief A hidraw node of an Apple Pro Display XDR added or removed.
+ *
+ * @param action Whether the node was removed, or added (or changed, and possibly made accessible).
+ * @param node The path of the node, e.g. `/dev/hidraw3`.
+ */
+struct hotplug_event {
+  enum hotplug_action action;
+  char node[PATH_MAX];
+};
+
+int hotplug_open(void);
+int hotplug_receive(int fd, struct hotplug_event* event);
+
+#endif  // APDBCTL_HOTPLUG_H
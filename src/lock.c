@@ -0,0 +1,167 @@
+#include "lock.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "runtime.h"
+#include "stats.h"
+#include "trace.h"
+
+#define DEVICE_LOCK_NAME "lock"
+#define DEVICE_QUEUE_NAME "lock-queue"
+#define DEVICE_QUEUE_CAPACITY 64
+// A waiter that finds the queue full retries on this many polls (about 40ms), then gives up.
+#define DEVICE_QUEUE_FULL_POLLS 8
+#define DEVICE_LOCK_MIN_POLL_NS 500000ull
+#define DEVICE_LOCK_MAX_POLL_NS 8000000ull
+
+/**
+ * @brief Opens a file of the runtime directory for locking.
+ *
+ * @param name[in] The name of the file.
+ * @return The file descriptor, or -1 on error.
+ */
+static int open_lock_file(const char* name) {
+  char path[PATH_MAX];
+  if (!runtime_path(path, sizeof(path), name, /* create_directory= */ true)) {
+    return -1;
+  }
+  return open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+}
+
+static void lock_file(int fd, int operation) {
+  while (flock(fd, operation) < 0 && errno == EINTR) {
+  }
+}
+
+/**
+ * @brief Updates the queue of waiting invocations. Must be called with the queue locked.
+ *
+ * The queue holds the process IDs of the waiting invocations, one per line, in arrival order.
+ * Invocations that exited without leaving the queue (e.g. killed while waiting) are dropped.
+ *
+ * @param fd[in] The queue file.
+ * @param add[in] The process ID to append if it is not queued yet, or 0.
+ * @param remove[in] The process ID to remove, or 0.
+ * @param queued[out] Whether `add` is in the queue: false if the queue is full, or `add` is 0.
+ * @return The process ID at the head of the queue, or 0 if it is empty.
+ */
+static pid_t update_queue(int fd, pid_t add, pid_t remove, bool* queued) {
+  char contents[DEVICE_QUEUE_CAPACITY * 12];
+  pid_t pids[DEVICE_QUEUE_CAPACITY];
+  size_t count = 0;
+  *queued = false;
+
+  ssize_t length = pread(fd, contents, sizeof(contents) - 1, 0);
+  contents[length > 0 ? length : 0] = '\0';
+
+  for (char* line = strtok(contents, "\n"); line && count < DEVICE_QUEUE_CAPACITY;
+       line = strtok(NULL, "\n")) {
+    pid_t pid = (pid_t)strtol(line, NULL, /* base= */ 10);
+    if (pid > 0 && pid != remove && (kill(pid, 0) == 0 || errno == EPERM)) {
+      *queued |= add && pid == add;
+      pids[count++] = pid;
+    }
+  }
+  if (add && !*queued && count < DEVICE_QUEUE_CAPACITY) {
+    pids[count++] = add;
+    *queued = true;
+  }
+
+  length = 0;
+  for (size_t i = 0; i < count; ++i) {
+    length += snprintf(contents + length, sizeof(contents) - length, "%ld\n", (long)pids[i]);
+  }
+  if (pwrite(fd, contents, length, 0) != length || ftruncate(fd, length) < 0) {
+    // Best effort: a stale queue only costs an extra poll to the waiters.
+  }
+  return count ? pids[0] : 0;
+}
+
+/**
+ * @brief Waits for exclusive access to the displays, behind the invocations already waiting.
+ *
+ * The displays are guarded by an advisory `flock` on a file of the runtime directory, released by
+ * the kernel if the holder dies. Waiters queue in a second file, and only the head of the queue
+ * tries the lock, so that access is granted in arrival order. Without a runtime directory, locking
+ * is skipped, like the device cache. A waiter that cannot join a full queue gives up early, with
+ * `queue_full` set, rather than waiting for a turn that never comes.
+ *
+ * @param lock[out] The lock, to release with `device_lock_release`.
+ * @param timeout_ns[in] How long to wait at most, or `DEVICE_LOCK_WAIT_FOREVER`.
+ * @return Whether the lock was acquired, or locking is unavailable.
+ */
+bool device_lock_acquire(struct device_lock* lock, uint64_t timeout_ns) {
+  *lock = (struct device_lock){.fd = open_lock_file(DEVICE_LOCK_NAME)};
+  int queue_fd = open_lock_file(DEVICE_QUEUE_NAME);
+  if (lock->fd < 0 || queue_fd < 0) {
+    if (queue_fd >= 0) {
+      close(queue_fd);
+    }
+    return true;
+  }
+
+  uint64_t trace_start_ns = trace_begin();
+  uint64_t start_ns = monotonic_ns();
+  pid_t self = getpid();
+  bool queued;
+  bool acquired = false;
+  unsigned int full_polls = 0;
+  uint64_t poll_ns = DEVICE_LOCK_MIN_POLL_NS;
+
+  for (;;) {
+    lock_file(queue_fd, LOCK_EX);
+    // Appends this invocation on the first poll, or on a later one if the queue was full.
+    pid_t head = update_queue(queue_fd, self, 0, &queued);
+    if (head == self && !flock(lock->fd, LOCK_EX | LOCK_NB)) {
+      acquired = true;
+    }
+    full_polls = queued ? 0 : full_polls + 1;
+    lock->queue_full = full_polls >= DEVICE_QUEUE_FULL_POLLS;
+
+    uint64_t now_ns = monotonic_ns();
+    bool expired = (timeout_ns != DEVICE_LOCK_WAIT_FOREVER && now_ns - start_ns >= timeout_ns) ||
+                   lock->queue_full;
+    if ((acquired || expired) && queued) {
+      update_queue(queue_fd, 0, self, &queued);
+    }
+    lock_file(queue_fd, LOCK_UN);
+
+    if (acquired || expired) {
+      break;
+    }
+    // Poll quickly at first: most critical sections last a few milliseconds.
+    sleep_until(now_ns + poll_ns);
+    poll_ns = poll_ns * 2 < DEVICE_LOCK_MAX_POLL_NS ? poll_ns * 2 : DEVICE_LOCK_MAX_POLL_NS;
+  }
+
+  close(queue_fd);
+  lock->waited_ns = monotonic_ns() - start_ns;
+  statistics_add(STAT_LOCK_WAIT_NS, lock->waited_ns);
+  trace_end("lock_wait", acquired ? NULL : lock->queue_full ? "queue full" : "timeout",
+            trace_start_ns);
+  if (!acquired) {
+    close(lock->fd);
+    lock->fd = -1;
+  }
+  return acquired;
+}
+
+/**
+ * @brief Releases exclusive access to the displays.
+ */
+void device_lock_release(struct device_lock* lock) {
+  if (lock->fd >= 0) {
+    close(lock->fd);
+    lock->fd = -1;
+  }
+}
@@ -0,0 +1,25 @@
+#ifndef APDBCTL_LOCK_H
+#define APDBCTL_LOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DEVICE_LOCK_WAIT_FOREVER UINT64_MAX
+
+/**
+ * @brief Exclusive access to the displays, shared by all invocations of the user.
+ *
+ * @param fd The locked file, or -1 if locking is unavailable.
+ * @param waited_ns The time spent waiting for other invocations.
+ * @param queue_full Whether the lock was given up on because too many invocations were waiting.
+ */
+struct device_lock {
+  int fd;
+  uint64_t waited_ns;
+  bool queue_full;
+};
+
+bool device_lock_acquire(struct device_lock* lock, uint64_t timeout_ns);
+void device_lock_release(struct device_lock* lock);
+
+#endif  // APDBCTL_LOCK_H
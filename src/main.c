@@ -2,39 +2,29 @@
 #include <errno.h>
 #include <hidapi.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
-#if defined(__APPLE__)
-#include <libkern/OSByteOrder.h>
-#define htole32(x) OSSwapHostToLittleInt32(x)
-#define le16toh(x) OSSwapLittleToHostInt16(x)
-#define le32toh(x) OSSwapLittleToHostInt32(x)
-#else
-#include <endian.h>
-#endif
-
-#define APPLE_INC 0x05ac
-#define PRO_DISPLAY_XDR 0x9243
-#define BRIGHTNESS_REPORT_ID 0x1
-#define BRIGHTNESS_REPORT_PAGE 0x8005
-#define BRIGHTNESS_REPORT_USAGE 0x1009
-#define BRIGHTNESS_MIN 0x0190  // 400
-#define BRIGHTNESS_MAX 0xc350  // 50_000
-#define BRIGHTNESS_RANGE (BRIGHTNESS_MAX - BRIGHTNESS_MIN)
-
-#if BRIGHTNESS_MIN >= BRIGHTNESS_MAX
-#error "BRIGHTNESS_MIN must be strictly less than BRIGHTNESS_MAX"
-#endif
-
-#define SUCCESS 0
-#define ERR_INVALID_ARGUMENT 1
-#define ERR_DEVICE_NOT_FOUND 2
-#define ERR_HIDAPI_CALL_FAIL 3
-#define ERR_INVALID_PRECONDITION 4
+#include "batch.h"
+#include "bench.h"
+#include "brightness.h"
+#include "clock.h"
+#include "device.h"
+#include "fade.h"
+#include "hotplug.h"
+#include "lock.h"
+#include "stats.h"
+#include "status.h"
+#include "trace.h"
+#include "verify.h"
 
 /**
  * @brief Prints usage on standard error.
@@ -45,10 +35,48 @@ static void print_usage(const char* program_name) {
   // clang-format off
   fprintf(stderr, "%s v%s, revision %s, distributed by: %s\n", PROJECT_NAME, VERSION, GIT_REVISION, DISTRIBUTOR);
   fprintf(stderr, "\n");
-  fprintf(stderr, "Usage: %s <command> [arguments]\n", program_name);
+  fprintf(stderr, "Usage: %s [options] [display] <command> [arguments]\n", program_name);
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --trace <file>             Write a Chrome trace of device operations to file\n");
+  fprintf(stderr, "  --stats                    Print device I/O and resource counters at exit\n");
+  fprintf(stderr, "  --backend <hidapi|hidraw>  Open devices through hidapi, or the hidraw ioctls\n");
+  fprintf(stderr, "  --wait <duration>          Give up if other invocations hold the displays longer\n");
+  fprintf(stderr, "Display:\n");
+  fprintf(stderr, "  --all                      Operate on all displays concurrently\n");
+  fprintf(stderr, "  --serial <serial>          Operate on the display with this serial number\n");
+  fprintf(stderr, "  --index <index>            Operate on the display at this index in 'list'\n");
+  fprintf(stderr, "  Defaults to the first display.\n");
+  fprintf(stderr, "\n");
   fprintf(stderr, "Commands:\n");
+  fprintf(stderr, "  list                       List displays: index, serial number and device path\n");
   fprintf(stderr, "  get [-%% | -p | --percent]  Get current brightness (absolute or percentage)\n");
-  fprintf(stderr, "  set <value>                Set brightness to value (integer or percentage)\n");
+  fprintf(stderr, "      [--cached]             Read it from the running daemon, if any\n");
+  fprintf(stderr, "  set <value> [options]      Set brightness to value (integer or percentage)\n");
+  fprintf(stderr, "  watch [-%%] [--json]        Print brightness changes as they happen\n");
+  fprintf(stderr, "  wait [options]             Wait for the display to be connected\n");
+  fprintf(stderr, "  batch [file]               Run commands from file (or standard input)\n");
+  fprintf(stderr, "  bench [options]            Measure the latency of device and daemon operations\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options for set:\n");
+  fprintf(stderr, "  --fade <duration>          Fade to value over duration, e.g. \"500ms\" or \"2s\"\n");
+  fprintf(stderr, "  --curve <curve>            Fade curve: linear (default), ease or perceptual\n");
+  fprintf(stderr, "  --sync                     Update all selected displays at the same time\n");
+  fprintf(stderr, "  --verify                   Read the value back, resending it until confirmed\n");
+  fprintf(stderr, "  --force                    apdbctl-client only: send value even if the daemon\n");
+  fprintf(stderr, "                             knows the display has it (ignored otherwise)\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options for wait:\n");
+  fprintf(stderr, "  --timeout <duration>       Give up after duration (default: wait indefinitely)\n");
+  fprintf(stderr, "  --then set <value>         Set brightness to value once connected\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options for bench:\n");
+  fprintf(stderr, "  --iterations <n>           Iterations of each measurement (default: 100)\n");
+  fprintf(stderr, "  --mode <mode>              phases, warm, cold, daemon, spawn or all, repeatable\n");
+  fprintf(stderr, "                             (default: phases, warm and cold)\n");
+  fprintf(stderr, "  --json                     Print one JSON object per measurement\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Batch commands, one per line:\n");
+  fprintf(stderr, "  get [-%%], set <value>, sleep <duration>\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Brightness value:\n");
   fprintf(stderr, "  Valid integer values are in the range [400, 50000], inclusive.\n");
@@ -56,331 +84,734 @@ static void print_usage(const char* program_name) {
   fprintf(stderr, "\n");
   fprintf(stderr, "Examples:\n");
   fprintf(stderr, "  %s set 400\n", program_name);
-  fprintf(stderr, "  %s set 30%\n", program_name);
+  fprintf(stderr, "  %s set 30%%\n", program_name);
+  fprintf(stderr, "  %s set 80%% --fade 2s --curve perceptual\n", program_name);
+  fprintf(stderr, "  %s --all set 50%%\n", program_name);
   // clang-format on
 }
 
+// Leaves time for every worker to wake up from the start gate before the shared deadline.
+#define SYNC_LEAD_NS 1000000ull
+
 /**
- * @brief Checks whether a device is from an Apple Pro Display XDR.
+ * @brief A start gate releasing workers at a shared absolute deadline.
  *
- * The Pro Display XDR advertises 4 HID interfaces, but only one of them is capable of brightness
- * control. This only checks if this is one of the 4 advertised interfaces.
+ * Workers prepare their operation, then wait at the gate. Once every participant arrived, the gate
+ * opens with a deadline slightly in the future, which all participants sleep until before sending
+ * their first feature report.
  *
- * @param device[in] The HID device to inspect.
- * @return Whether the device's vendor and product IDs matches that of the Apple Pro Display XDR.
- * @see hid_is_apple_pro_display_xdr_brightness_control_device
+ * @param participants The number of workers expected at the gate.
+ * @param arrived The number of workers waiting at the gate.
+ * @param deadline_ns The shared deadline on the monotonic clock, or 0 while the gate is closed.
  */
-static bool is_apple_pro_display_xdr_device(struct hid_device_info* device) {
-  return device->vendor_id == APPLE_INC && device->product_id == PRO_DISPLAY_XDR;
-}
+struct start_gate {
+  pthread_mutex_t mutex;
+  pthread_cond_t opened;
+  size_t participants;
+  size_t arrived;
+  uint64_t deadline_ns;
+};
 
 /**
- * @brief A HID report descriptor prefix.
- *
- * This descriptor is incomplete and only intended to match the first bytes of the Apple Pro Display
- * XDR brightness control device descriptor.
- *
- * @param usage_page HID usage page (global item) indicating the category of controls.
- * @param usage HID usage (global item) indicating the specific control within the page.
- * @param collection Collection type (e.g., application or logical grouping of controls).
- * @param report_id Report ID identifying this report for multi-report devices.
- * @param report_usage_pages Array of usage pages referenced in the report (local items).
- * @param report_usage Usage referenced in the report (local item).
- * @param logical_minimum_size Size in bytes of the logical minimum field.
- * @param logical_minimum Logical minimum value allowed for the control.
- * @param logical_maximum_size Size in bytes of the logical maximum field.
- * @param logical_maximum Logical maximum value allowed for the control.
- * @param unit HID unit descriptor bytes (specifies measurement units).
- * @param unit_exponent Exponent used with unit to scale the reported value.
- * @param report_size Size in bits of each element in the report.
- * @param report_count Number of elements in the report.
- * @param feature Feature flag for the report (typically the feature ID or type).
+ * @brief Opens the gate if every participant arrived. Must be called with the gate locked.
+ *
+ * @param gate[in,out] The start gate.
  */
-struct __attribute__((packed)) hid_report_descriptor {
-  uint16_t usage_page;
-  uint16_t usage;
-  uint16_t collection;
-  uint16_t report_id;
-  uint8_t report_usage_pages[3];
-  uint16_t report_usage;
-  uint8_t logical_minimum_size;
-  int16_t logical_minimum;
-  uint8_t logical_maximum_size;
-  int32_t logical_maximum;
-  uint8_t unit[5];
-  uint16_t unit_exponent;
-  uint16_t report_size;
-  uint16_t report_count;
-  uint16_t feature;
-};
+static void start_gate_open_if_ready(struct start_gate* gate) {
+  if (!gate->deadline_ns && gate->arrived == gate->participants) {
+    gate->deadline_ns = monotonic_ns() + SYNC_LEAD_NS;
+    pthread_cond_broadcast(&gate->opened);
+  }
+}
 
 /**
- * @brief Checks whether a device is an Apple Pro Display XDR brightness control device.
+ * @brief Waits for every participant to arrive at the gate.
  *
- * The Pro Display XDR advertises 4 HID interfaces, but only one of them is capable of brightness
- * control. This only checks if the report descriptor of the given `device` matches the Apple Pro
- * Display XDR brightness control device.
+ * @param gate[in,out] The start gate.
+ * @return The shared deadline to start at, on the monotonic clock.
+ */
+static uint64_t start_gate_wait(struct start_gate* gate) {
+  pthread_mutex_lock(&gate->mutex);
+  ++gate->arrived;
+  start_gate_open_if_ready(gate);
+  while (!gate->deadline_ns) {
+    pthread_cond_wait(&gate->opened, &gate->mutex);
+  }
+  uint64_t deadline_ns = gate->deadline_ns;
+  pthread_mutex_unlock(&gate->mutex);
+  return deadline_ns;
+}
+
+/**
+ * @brief Withdraws a participant that will never arrive at the gate.
  *
- * @param device[in] The HID device to inspect.
- * @return Whether the device's report descriptor matches that of the Apple Pro Display XDR
- *   brightness control device.
- * @see hid_is_apple_pro_display_xdr_device
+ * @param gate[in,out] The start gate.
  */
-static bool hid_is_apple_pro_display_xdr_brightness_control_device(hid_device* device) {
-  struct hid_report_descriptor descriptor;
+static void start_gate_leave(struct start_gate* gate) {
+  pthread_mutex_lock(&gate->mutex);
+  --gate->participants;
+  start_gate_open_if_ready(gate);
+  pthread_mutex_unlock(&gate->mutex);
+}
 
-  int bytes_read =
-      hid_get_report_descriptor(device, (unsigned char*)&descriptor, sizeof(descriptor));
+/**
+ * @brief A brightness operation on a single display.
+ *
+ * @param display The display to operate on.
+ * @param brightness The absolute brightness to set, or the brightness read.
+ * @param fade_duration_ns The duration of the transition, or 0 to set the value immediately.
+ * @param curve The interpolation curve of the transition.
+ * @param gate The start gate to wait at before sending the first report, or NULL.
+ * @param statistics Pacing statistics of the transition.
+ * @param verify Whether to read the brightness back once set.
+ * @param verification The outcome of the read-back, if `verify` and the brightness was set.
+ * @param report_ns The time the first feature report was sent, on the monotonic clock.
+ * @param status The result of the operation: `SUCCESS` or one of `ERR_*`.
+ */
+struct display_job {
+  struct display* display;
+  uint32_t brightness;
+  uint64_t fade_duration_ns;
+  enum fade_curve curve;
+  struct start_gate* gate;
+  struct fade_statistics statistics;
+  bool verify;
+  struct verify_statistics verification;
+  uint64_t report_ns;
+  int status;
+};
 
-  if (bytes_read != sizeof(descriptor)) {
-    fprintf(stderr,
-            "error: found Apple Pro Display XDR device but failed to retrieve "
-            "Report Descriptor: %ls\n",
-            hid_error(device));
-    return false;
-  }
+/**
+ * @brief Reads the brightness of a display.
+ *
+ * @param argument[in,out] The `struct display_job` to run.
+ * @return NULL.
+ */
+static void* get_brightness_job(void* argument) {
+  struct display_job* job = argument;
 
-  return le16toh(descriptor.usage_page) == BRIGHTNESS_REPORT_PAGE &&
-         le16toh(descriptor.report_usage) == BRIGHTNESS_REPORT_USAGE &&
-         (le16toh(descriptor.report_id) >> 8 & 0xff) == BRIGHTNESS_REPORT_ID &&
-         le16toh(descriptor.logical_minimum) == BRIGHTNESS_MIN &&
-         le32toh(descriptor.logical_maximum) == BRIGHTNESS_MAX;
+  int32_t brightness = hid_get_brightness(job->display->device);
+  job->status = brightness < 0 ? ERR_HIDAPI_CALL_FAIL : SUCCESS;
+  job->brightness = brightness;
+  return NULL;
 }
 
 /**
- * @brief Finds and opens the Apple Pro Display XDR brightness control HID device.
- *
- * Iterates over connect HID devices and fetches the report descriptor to find the Apple Pro Display
- * XDR brightness control HID device.
+ * @brief Sets the brightness of a display, immediately or with a transition.
  *
- * The Pro Display XDR advertises 4 HID interfaces, but only one of them is capable of brightness
- * control.
+ * When the job has a start gate, the current brightness is read before waiting at the gate, so that
+ * only the feature reports are synchronized across displays. Verification, if requested, runs once
+ * the brightness is set, on the same handle.
  *
- * @return The HID device if found, or NULL otherwise.
- * @see README.md
+ * @param argument[in,out] The `struct display_job` to run.
+ * @return NULL.
  */
-static hid_device* hid_open_apple_pro_display_xdr_brightness_control_device() {
-  struct hid_device_info* devices = hid_enumerate(0x0, 0x0);
+static void* set_brightness_job(void* argument) {
+  struct display_job* job = argument;
+  struct device* device = job->display->device;
+  bool success;
 
-  for (struct hid_device_info* it = devices; it; it = it->next) {
-    if (!is_apple_pro_display_xdr_device(it)) {
-      continue;
-    }
+  int32_t current = job->fade_duration_ns ? hid_get_brightness(device) : 0;
+  uint64_t start_ns = job->gate ? start_gate_wait(job->gate) : 0;
 
-    hid_device* device = hid_open_path(it->path);
-    if (!device) {
-      fprintf(stderr, "error: failed to open device: %s\n", it->path);
-      continue;
-    }
-    if (!hid_is_apple_pro_display_xdr_brightness_control_device(device)) {
-      hid_close(device);
-      continue;
+  if (current < 0) {
+    success = false;
+  } else if (job->fade_duration_ns) {
+    success = fade_brightness(device, current, job->brightness, start_ns, job->fade_duration_ns,
+                              job->curve, &job->statistics);
+    job->report_ns = job->statistics.first_report_ns;
+  } else {
+    if (start_ns) {
+      sleep_until(start_ns);
     }
+    job->report_ns = monotonic_ns();
+    success = hid_set_brightness(device, job->brightness);
+  }
 
-    hid_free_enumeration(devices);
-    return device;
+  if (success && job->verify) {
+    // A fade is confirmed from its last step, rather than from its first one.
+    uint64_t sent_ns = job->fade_duration_ns ? monotonic_ns() : job->report_ns;
+    success = verify_brightness(device, job->brightness, sent_ns, &job->verification);
   }
 
-  hid_free_enumeration(devices);
+  job->status = success ? SUCCESS : ERR_HIDAPI_CALL_FAIL;
   return NULL;
 }
 
 /**
- * @brief A HID feature report for brightness on Apple Pro Display XDR monitors.
- *
- * @param report_id The HID report ID. Must be `BRIGHTNESS_REPORT_ID`.
- * @param brightness The absolute brightness value. This value is encoded in little-endian.
- * @param padding Unused bytes.
- */
-struct __attribute__((packed)) brightness_feature_report {
-  uint8_t report_id;
-  uint32_t brightness;
-  uint16_t padding;
-};
-
-/**
- * @brief Fetches a HID feature report to get the brightness value.
+ * @brief Runs one job per display concurrently.
  *
- * @param device[in] The HID device to fetch the report from.
+ * Each display gets its own worker thread, so that operating on several displays costs about as
+ * much as operating on one. A single job runs on the calling thread. Jobs whose worker could not be
+ * started withdraw from their start gate, if any, and run unsynchronized on the calling thread.
  *
- * @retval >=0 The absolute brightness value.
- * @retval -1 Failed to fetch HID report.
+ * @param jobs[in,out] The jobs to run.
+ * @param count[in] The number of jobs.
+ * @param run[in] The function running a job.
+ * @return `SUCCESS` if all jobs succeeded, or the status of the first job that failed.
  */
-static int32_t hid_get_brightness(hid_device* device) {
-  struct brightness_feature_report report = {0};
-  report.report_id = BRIGHTNESS_REPORT_ID;
+static int run_display_jobs(struct display_job* jobs, size_t count, void* (*run)(void*)) {
+  pthread_t workers[MAX_DISPLAYS];
+  bool started[MAX_DISPLAYS] = {false};
 
-  if (hid_get_feature_report(device, (unsigned char*)&report, sizeof(report)) < 0) {
-    fprintf(stderr, "error: failed to retrieve feature report: %ls\n", hid_error(device));
-    return -1;
+  for (size_t i = 1; i < count; ++i) {
+    started[i] = !pthread_create(&workers[i], NULL, run, &jobs[i]);
+    if (!started[i] && jobs[i].gate) {
+      start_gate_leave(jobs[i].gate);
+      jobs[i].gate = NULL;
+    }
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (!started[i]) {
+      run(&jobs[i]);
+    }
   }
 
-  return le32toh(report.brightness);
+  int status = SUCCESS;
+  for (size_t i = 0; i < count; ++i) {
+    if (started[i]) {
+      pthread_join(workers[i], NULL);
+    }
+    if (status == SUCCESS) {
+      status = jobs[i].status;
+    }
+  }
+  return status;
 }
 
 /**
- * @brief Sends a HID feature report to update the brightness value.
+ * @brief Prints the spread of the first feature report times across displays on standard error.
  *
- * Parameter must be a valid absolute value (i.e. in [BRIGHTNESS_MIN, BRIGHTNESS_MAX]).
+ * Also prints each display's offset from the earliest report.
  *
- * @param device[in] The HID device to send the report to.
- * @param brightness[in] The absolute brightness value to request.
- *
- * @retval true HID report sent successfully.
- * @retval false Failed to send HID report.
+ * @param jobs[in] The completed jobs.
+ * @param count[in] The number of jobs.
  */
-static bool hid_set_brightness(hid_device* device, uint32_t brightness) {
-  assert(brightness >= BRIGHTNESS_MIN && brightness <= BRIGHTNESS_MAX);
+static void print_report_skew(const struct display_job* jobs, size_t count) {
+  uint64_t earliest_ns = UINT64_MAX;
+  uint64_t latest_ns = 0;
+  size_t reported = 0;
 
-  struct brightness_feature_report report = {0};
-  report.report_id = BRIGHTNESS_REPORT_ID;
-  report.brightness = htole32(brightness);
+  for (size_t i = 0; i < count; ++i) {
+    if (jobs[i].report_ns) {
+      earliest_ns = jobs[i].report_ns < earliest_ns ? jobs[i].report_ns : earliest_ns;
+      latest_ns = jobs[i].report_ns > latest_ns ? jobs[i].report_ns : latest_ns;
+      ++reported;
+    }
+  }
 
-  if (hid_send_feature_report(device, (unsigned char*)&report, sizeof(report)) < 0) {
-    fprintf(stderr, "error: failed to send feature report: %ls\n", hid_error(device));
-    return false;
+  if (!reported) {
+    return;
   }
 
-  return true;
+  for (size_t i = 0; i < count; ++i) {
+    if (jobs[i].report_ns) {
+      fprintf(stderr, "sync: %s +%.3fms\n", jobs[i].display->serial,
+              (double)(jobs[i].report_ns - earliest_ns) / 1e6);
+    }
+  }
+  fprintf(stderr, "sync: %zu displays, skew %.3fms\n", reported,
+          (double)(latest_ns - earliest_ns) / 1e6);
 }
 
 /**
- * @brief Converts an absolute brightness value into a percentage one.
- *
- * Parameter must be a valid absolute value (i.e. in [BRIGHTNESS_MIN, BRIGHTNESS_MAX]).
- * Floating-point values are truncated toward zero.
+ * @brief Opens the selected displays, reporting an error if there are none.
  *
- * @param absolute[in] The absolute value to convert to percentage.
- * @return The percentage brightness value (in [0, 100]).
+ * @param selector[in] The display selection.
+ * @param displays[out] The selected displays, opened.
+ * @return The number of displays opened.
  */
-static uint8_t to_percent_brightness(uint32_t absolute) {
-  assert(absolute >= BRIGHTNESS_MIN && absolute <= BRIGHTNESS_MAX);
+static size_t open_selected_displays(const struct display_selector* selector,
+                                     struct display* displays) {
+  size_t count = open_displays(selector, displays, MAX_DISPLAYS);
+  if (!count) {
+    fprintf(stderr, "error: Apple Pro Display XDR brightness control device not found.\n");
+  }
+  return count;
+}
 
-  uint8_t percentage = (uint8_t)((absolute - BRIGHTNESS_MIN) / (float)BRIGHTNESS_RANGE * 100);
-  assert(percentage >= 0 && percentage <= 100);
+// Waits shorter than this are not worth reporting: an uncontended lock takes microseconds.
+#define LOCK_REPORT_NS 1000000ull
 
-  return percentage;
-}
+// How long `get`, `set`, `wait` and `batch` wait for other invocations to release the displays.
+static uint64_t lock_timeout_ns = DEVICE_LOCK_WAIT_FOREVER;
 
 /**
- * @brief Converts a percentage brightness value into an absolute one.
+ * @brief Waits for other invocations to be done with the displays.
  *
- * Parameter must be a valid percentage value (i.e. in [0, 100]).
- * Floating-point values are truncated toward zero.
+ * Concurrent invocations (e.g. a fade started from a hotkey while another one is running) would
+ * otherwise interleave their feature reports. Time spent waiting is reported on standard error.
  *
- * @param percentage[in] The percentage value to convert to absolute.
- * @return The absolute brightness value (in [BRIGHTNESS_MIN, BRIGHTNESS_MAX]).
+ * @param lock[out] The lock, to release with `device_lock_release` once the displays are closed.
+ * @return Whether the displays are available.
  */
-static uint32_t to_absolute_brightness(uint8_t percentage) {
-  assert(percentage >= 0 && percentage <= 100);
-
-  uint32_t absolute = (percentage * BRIGHTNESS_RANGE / 100) + BRIGHTNESS_MIN;
-  assert(absolute >= BRIGHTNESS_MIN && absolute <= BRIGHTNESS_MAX);
-
-  return absolute;
+static bool lock_displays(struct device_lock* lock) {
+  if (!device_lock_acquire(lock, lock_timeout_ns)) {
+    if (lock->queue_full) {
+      fprintf(stderr, "error: displays busy, too many invocations waiting.\n");
+    } else {
+      fprintf(stderr, "error: displays busy, gave up after %.1fms.\n", lock->waited_ns / 1e6);
+    }
+    return false;
+  }
+  if (lock->waited_ns >= LOCK_REPORT_NS) {
+    fprintf(stderr, "lock: waited %.1fms for other invocations\n", lock->waited_ns / 1e6);
+  }
+  return true;
 }
 
 /**
  * @brief Prints the current brightness value on the standard output.
  *
- * Reads the value from the HID device and formats it accordingly.
+ * Reads the value from the HID device and formats it accordingly. When several displays are
+ * selected, each value is prefixed with the serial number of its display.
  *
+ * @param selector[in] The displays to read the brightness of.
  * @param as_percentage_point[in] Whether to print the value as absolute or percentage.
  *
  * @retval SUCCESS Brightness value printed successully on standard output.
  * @retval ERR_DEVICE_NOT_FOUND Apple Pro Display XDR brightness control device not found.
  * @retval ERR_HIDAPI_CALL_FAIL Failed to retrieve HID feature report.
+ * @retval ERR_INVALID_PRECONDITION Other invocations held the displays longer than `--wait`.
  */
-static int print_brightness(bool as_percentage_point) {
-  hid_device* device = hid_open_apple_pro_display_xdr_brightness_control_device();
-  if (!device) {
-    fprintf(stderr, "error: Apple Pro Display XDR brightness control device not found.\n");
+static int print_brightness(const struct display_selector* selector, bool as_percentage_point) {
+  struct device_lock lock;
+  if (!lock_displays(&lock)) {
+    return ERR_INVALID_PRECONDITION;
+  }
+
+  struct display displays[MAX_DISPLAYS];
+  size_t count = open_selected_displays(selector, displays);
+  if (!count) {
+    device_lock_release(&lock);
     return ERR_DEVICE_NOT_FOUND;
   }
 
-  int32_t brightness = hid_get_brightness(device);
-  hid_close(device);
+  struct display_job jobs[MAX_DISPLAYS];
+  for (size_t i = 0; i < count; ++i) {
+    jobs[i] = (struct display_job){.display = &displays[i]};
+  }
+
+  int status = run_display_jobs(jobs, count, get_brightness_job);
+  close_displays(displays, count);
+  device_lock_release(&lock);
+
+  for (size_t i = 0; i < count; ++i) {
+    if (jobs[i].status != SUCCESS) {
+      continue;
+    }
+    if (count > 1) {
+      printf("%s ", displays[i].serial);
+    }
+    if (as_percentage_point) {
+      printf("%u%%\n", to_percent_brightness(jobs[i].brightness));
+    } else {
+      printf("%u\n", jobs[i].brightness);
+    }
+  }
+
+  return status;
+}
 
-  if (brightness < 0) {
-    return ERR_HIDAPI_CALL_FAIL;
+/**
+ * @brief Prints the brightness published by the daemon, without any device I/O.
+ *
+ * @param as_percentage_point[in] Whether to print the value as absolute or percentage.
+ * @return Whether a running daemon published the brightness of its display.
+ * @see status_page_read
+ */
+static bool print_cached_brightness(bool as_percentage_point) {
+  const struct status_page* page = status_page_map();
+  struct status_snapshot snapshot;
+  // A daemon that was killed could not mark its page as stopped.
+  bool cached = page && status_page_read(page, &snapshot) && snapshot.state == STATUS_CONNECTED &&
+                snapshot.brightness && (!kill(snapshot.pid, 0) || errno == EPERM);
+  status_page_unmap(page);
+  if (!cached) {
+    return false;
   }
 
   if (as_percentage_point) {
-    printf("%u%%\n", to_percent_brightness(brightness));
+    printf("%u%%\n", to_percent_brightness(snapshot.brightness));
   } else {
-    printf("%u\n", brightness);
+    printf("%u\n", snapshot.brightness);
   }
-
-  return SUCCESS;
+  return true;
 }
 
 /**
  * @brief Sets the brightness of the screen.
  *
+ * @param selector[in] The displays to set the brightness of.
  * @param value[in] The integer value of the requested brightness target.
  * @param as_percentage_point[in] Whether to interpret `value` as absolute or percentage.
+ * @param fade_duration_ns[in] The duration of the transition, or 0 to set the value immediately.
+ * @param curve[in] The interpolation curve of the transition.
+ * @param synchronized[in] Whether to send the feature reports of all displays at the same time.
+ * @param verify[in] Whether to read the brightness back, and resend it until the display reports
+ *   it.
  *
  * @retval SUCCESS Brightness updated successfully.
  * @retval ERR_DEVICE_NOT_FOUND Apple Pro Display XDR brightness control device not found.
- * @retval ERR_HIDAPI_CALL_FAIL Failed to send HID feature report.
+ * @retval ERR_HIDAPI_CALL_FAIL Failed to send or retrieve HID feature report, or the display did
+ *   not confirm the brightness.
+ * @retval ERR_INVALID_PRECONDITION Other invocations held the displays longer than `--wait`.
  */
-static int set_brightness(uint32_t value, bool as_percentage_point) {
+static int set_brightness(const struct display_selector* selector, uint32_t value,
+                          bool as_percentage_point, uint64_t fade_duration_ns,
+                          enum fade_curve curve, bool synchronized, bool verify) {
   assert((as_percentage_point && value <= 100) ||
          (!as_percentage_point && value >= BRIGHTNESS_MIN && value <= BRIGHTNESS_MAX));
 
-  hid_device* device = hid_open_apple_pro_display_xdr_brightness_control_device();
-  if (!device) {
-    fprintf(stderr, "error: Apple Pro Display XDR brightness control device not found.\n");
+  struct device_lock lock;
+  if (!lock_displays(&lock)) {
+    return ERR_INVALID_PRECONDITION;
+  }
+
+  struct display displays[MAX_DISPLAYS];
+  size_t count = open_selected_displays(selector, displays);
+  if (!count) {
+    device_lock_release(&lock);
     return ERR_DEVICE_NOT_FOUND;
   }
 
-  bool success =
-      hid_set_brightness(device, as_percentage_point ? to_absolute_brightness(value) : value);
+  struct start_gate gate = {
+      .mutex = PTHREAD_MUTEX_INITIALIZER,
+      .opened = PTHREAD_COND_INITIALIZER,
+      .participants = count,
+  };
 
-  hid_close(device);
-  return success ? SUCCESS : ERR_HIDAPI_CALL_FAIL;
+  struct display_job jobs[MAX_DISPLAYS];
+  for (size_t i = 0; i < count; ++i) {
+    jobs[i] = (struct display_job){
+        .display = &displays[i],
+        .brightness = as_percentage_point ? to_absolute_brightness(value) : value,
+        .fade_duration_ns = fade_duration_ns,
+        .curve = curve,
+        .gate = synchronized ? &gate : NULL,
+        .verify = verify,
+    };
+  }
+
+  int status = run_display_jobs(jobs, count, set_brightness_job);
+  close_displays(displays, count);
+  device_lock_release(&lock);
+
+  if (synchronized) {
+    print_report_skew(jobs, count);
+  }
+
+  for (size_t i = 0; fade_duration_ns && i < count; ++i) {
+    if (jobs[i].status != SUCCESS) {
+      continue;
+    }
+    if (count > 1) {
+      fprintf(stderr, "%s ", displays[i].serial);
+    }
+    print_fade_statistics(&jobs[i].statistics);
+  }
+
+  for (size_t i = 0; verify && i < count; ++i) {
+    if (!jobs[i].verification.reads) {
+      continue;
+    }
+    if (count > 1) {
+      fprintf(stderr, "%s ", displays[i].serial);
+    }
+    print_verify_statistics(&jobs[i].verification, jobs[i].brightness);
+  }
+
+  return status;
 }
 
 /**
- * @brief Parses the input string as a brightness value.
+ * @brief Prints the connected displays on the standard output.
  *
- * Brightness value can be either absolute (an integer in [400, 50000]) or percentage ("50%").
+ * Each line holds the index, serial number and device path of a display.
  *
- * @param parameter[in] The string to parse.
- * @param value[out] The output value, if successful.
- * @param as_percentage_point[out] Whether `value` is absolute or percentage.
+ * @retval SUCCESS Displays printed successfully on standard output.
+ * @retval ERR_DEVICE_NOT_FOUND No Apple Pro Display XDR brightness control device found.
+ */
+static int list_displays(void) {
+  struct display displays[MAX_DISPLAYS];
+  size_t count = scan_displays(displays, MAX_DISPLAYS);
+
+  for (size_t i = 0; i < count; ++i) {
+    printf("%zu %s %s\n", i, *displays[i].serial ? displays[i].serial : "-", displays[i].path);
+  }
+
+  close_displays(displays, count);
+  return count ? SUCCESS : ERR_DEVICE_NOT_FOUND;
+}
+
+/**
+ * @brief Prints a brightness change on the standard output.
  *
- * @retval true Parsing successful.
- * @retval false Malformed absolute or percentage brightness value.
+ * @param brightness[in] The absolute brightness value.
+ * @param as_percentage_point[in] Whether to print the value as absolute or percentage.
+ * @param json[in] Whether to print a JSON object rather than a line of text.
  */
-static bool parse_brightness_parameter(const char* parameter, uint32_t* value,
-                                       bool* as_percentage_point) {
-  char* last = NULL;
+static void print_brightness_change(uint32_t brightness, bool as_percentage_point, bool json) {
+  struct timespec now;
+  struct tm time;
+  char timestamp[32];
 
-  errno = 0;
-  unsigned long parsed = strtoul(parameter, &last, /* base= */ 10);
+  clock_gettime(CLOCK_REALTIME, &now);
+  gmtime_r(&now.tv_sec, &time);
+  size_t length = strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &time);
+  snprintf(timestamp + length, sizeof(timestamp) - length, ".%03ldZ", now.tv_nsec / 1000000);
 
-  if (parsed == ULONG_MAX && errno) {
-    return false;
+  if (json) {
+    printf("{\"time\":\"%s\",\"brightness\":%u,\"percent\":%u}\n", timestamp, brightness,
+           to_percent_brightness(brightness));
+  } else if (as_percentage_point) {
+    printf("%s %u%%\n", timestamp, to_percent_brightness(brightness));
+  } else {
+    printf("%s %u\n", timestamp, brightness);
   }
+  fflush(stdout);
+}
 
-  // No digits found.
-  if (parameter == last) return false;
+// Without hotplug events, how often `wait` looks for the display.
+#define WAIT_POLL_NS 250000000ull
+
+/**
+ * @brief Blocks until the selected display is connected.
+ *
+ * Sleeps on the hotplug monitor, and only probes the nodes it reports as added. Without a monitor,
+ * looks the display up periodically instead.
+ *
+ * @param hotplug_fd[in] The hotplug monitor, or -1 if unavailable.
+ * @param selector[in] The display to wait for. Must select a single display.
+ * @param deadline_ns[in] When to give up, on the monotonic clock, or `UINT64_MAX` to never give up.
+ * @param display[out] The display, opened.
+ * @return Whether the display was opened, or false on timeout or if the monitor failed.
+ */
+static bool wait_for_display(int hotplug_fd, const struct display_selector* selector,
+                             uint64_t deadline_ns, struct display* display) {
+  struct pollfd fds = {.fd = hotplug_fd, .events = POLLIN};
 
-  if (*last == '%' && *(last + 1) == '\0' && parsed <= 100) {
-    *value = parsed;
-    *as_percentage_point = true;
-    return true;
+  for (;;) {
+    struct hotplug_event event;
+    int received = -1;
+    while (hotplug_fd >= 0 && (received = hotplug_receive(hotplug_fd, &event)) > 0) {
+      if (event.action == HOTPLUG_ADD && open_added_display(event.node, selector, display)) {
+        return true;
+      }
+    }
+    // Events were lost, or are unavailable: the display may have come back unnoticed.
+    if (received < 0 && open_displays(selector, display, 1)) {
+      return true;
+    }
+
+    uint64_t now_ns = monotonic_ns();
+    if (now_ns >= deadline_ns) {
+      return false;
+    }
+    if (hotplug_fd < 0) {
+      uint64_t wake_ns = now_ns + WAIT_POLL_NS;
+      sleep_until(wake_ns < deadline_ns ? wake_ns : deadline_ns);
+      continue;
+    }
+
+    int timeout_ms = -1;
+    if (deadline_ns != UINT64_MAX) {
+      uint64_t remaining_ms = (deadline_ns - now_ns + 999999) / 1000000;
+      timeout_ms = remaining_ms < INT_MAX ? (int)remaining_ms : INT_MAX;
+    }
+    if (poll(&fds, 1, timeout_ms) < 0 && errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+/**
+ * @brief Prints the brightness every time it changes, until an error occurs.
+ *
+ * Prints the current value first, then blocks on the input reports the display sends when its
+ * brightness changes, rather than polling the feature report. When the display is disconnected
+ * (e.g. power-cycled), waits for it to be connected again and resumes, where hotplug events are
+ * available.
+ *
+ * @param selector[in] The display to watch. Must select a single display.
+ * @param as_percentage_point[in] Whether to print values as absolute or percentage.
+ * @param json[in] Whether to print JSON objects rather than lines of text.
+ *
+ * @retval ERR_DEVICE_NOT_FOUND Apple Pro Display XDR brightness control device not found.
+ * @retval ERR_HIDAPI_CALL_FAIL Failed to retrieve HID feature or input report.
+ */
+static int watch_brightness(const struct display_selector* selector, bool as_percentage_point,
+                            bool json) {
+  // Started before the display is opened, so that no reconnection is missed.
+  int hotplug_fd = hotplug_open();
+
+  struct display display;
+  if (!open_displays(selector, &display, 1)) {
+    fprintf(stderr, "error: Apple Pro Display XDR brightness control device not found.\n");
+    if (hotplug_fd >= 0) {
+      close(hotplug_fd);
+    }
+    return ERR_DEVICE_NOT_FOUND;
   }
 
-  if (*last == '\0' && parsed >= BRIGHTNESS_MIN && parsed <= BRIGHTNESS_MAX) {
-    *value = parsed;
-    *as_percentage_point = false;
-    return true;
+  int32_t current = -1;
+  for (;;) {
+    int32_t brightness = hid_get_brightness(display.device);
+    while (brightness >= 0) {
+      if (brightness != current) {
+        print_brightness_change(brightness, as_percentage_point, json);
+      }
+      current = brightness;
+      brightness = hid_read_brightness(display.device, /* timeout_ms= */ -1);
+    }
+
+    close_displays(&display, 1);
+    if (hotplug_fd < 0) {
+      break;
+    }
+    fprintf(stderr, "hotplug: display disconnected, waiting for it\n");
+    if (!wait_for_display(hotplug_fd, selector, UINT64_MAX, &display)) {
+      break;
+    }
+    fprintf(stderr, "hotplug: display connected at %s\n", display.path);
   }
 
-  // Any other trailing character.
-  return false;
+  if (hotplug_fd >= 0) {
+    close(hotplug_fd);
+  }
+  return ERR_HIDAPI_CALL_FAIL;
+}
+
+/**
+ * @brief Waits for a display to be connected, then optionally sets its brightness.
+ *
+ * Meant for login and docking scripts, instead of retrying `get`: returns as soon as the
+ * brightness control device is found, without polling where hotplug events are available. The
+ * display is then reopened to set the brightness, with the displays locked like `set` does.
+ *
+ * @param selector[in] The display to wait for. Must select a single display.
+ * @param timeout_ns[in] How long to wait at most, or `UINT64_MAX` to wait indefinitely.
+ * @param set[in] Whether to set the brightness once the display is connected.
+ * @param brightness[in] The absolute brightness to set.
+ *
+ * @retval SUCCESS The display is connected, and its brightness was set if requested.
+ * @retval ERR_DEVICE_NOT_FOUND The display was not connected before the timeout, or was
+ *   disconnected before its brightness was set.
+ * @retval ERR_HIDAPI_CALL_FAIL Failed to send HID feature report.
+ * @retval ERR_INVALID_PRECONDITION Other invocations held the displays longer than `--wait`.
+ */
+static int wait_for_device(const struct display_selector* selector, uint64_t timeout_ns, bool set,
+                           uint32_t brightness) {
+  uint64_t start_ns = monotonic_ns();
+  uint64_t deadline_ns = timeout_ns < UINT64_MAX - start_ns ? start_ns + timeout_ns : UINT64_MAX;
+
+  // Started before the display is looked up, so that it cannot be connected unnoticed in between.
+  int hotplug_fd = hotplug_open();
+  struct display display;
+  bool found = open_displays(selector, &display, 1) ||
+               wait_for_display(hotplug_fd, selector, deadline_ns, &display);
+  if (hotplug_fd >= 0) {
+    close(hotplug_fd);
+  }
+  if (!found) {
+    fprintf(stderr, "error: Apple Pro Display XDR not connected after %.3fs.\n",
+            (monotonic_ns() - start_ns) / 1e9);
+    return ERR_DEVICE_NOT_FOUND;
+  }
+  close_displays(&display, 1);
+  if (!set) {
+    return SUCCESS;
+  }
+
+  // Reopened under the lock, like `set` does: the device cache makes this cheap.
+  struct device_lock lock;
+  if (!lock_displays(&lock)) {
+    return ERR_INVALID_PRECONDITION;
+  }
+  int status = SUCCESS;
+  if (!open_displays(selector, &display, 1)) {
+    status = ERR_DEVICE_NOT_FOUND;
+  } else {
+    if (!hid_set_brightness(display.device, brightness)) {
+      status = ERR_HIDAPI_CALL_FAIL;
+    }
+    close_displays(&display, 1);
+  }
+  device_lock_release(&lock);
+  return status;
+}
+
+/**
+ * @brief Options applying to every command.
+ *
+ * @param selector The display selection.
+ * @param trace_path The file to write a trace to, or NULL.
+ * @param stats Whether to print device I/O and resource counters at exit.
+ */
+struct global_options {
+  struct display_selector selector;
+  const char* trace_path;
+  bool stats;
+};
+
+/**
+ * @brief Parses the global and display selection options at the beginning of the command line.
+ *
+ * @param argc[in] The number of arguments.
+ * @param argv[in] The arguments, as received by `main`.
+ * @param options[out] The options.
+ * @return The index of the first argument following the options, or -1 on error.
+ */
+static int parse_global_options(int argc, char* argv[], struct global_options* options) {
+  *options = (struct global_options){.selector = {.index = -1}};
+  struct display_selector* selector = &options->selector;
+  int criteria = 0;
+  int i = 1;
+
+  for (; i < argc; ++i) {
+    if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+      options->trace_path = argv[++i];
+      continue;
+    } else if (!strcmp(argv[i], "--stats")) {
+      options->stats = true;
+      continue;
+    } else if (!strcmp(argv[i], "--backend") && i + 1 < argc) {
+      if (!select_device_backend(argv[++i])) {
+        fprintf(stderr, "error: unsupported backend '%s'.\n", argv[i]);
+        return -1;
+      }
+      // Processes spawned by `bench` use the same backend.
+      setenv("APDBCTL_BACKEND", argv[i], /* overwrite= */ 1);
+      continue;
+    } else if (!strcmp(argv[i], "--wait") && i + 1 < argc) {
+      if (!parse_duration(argv[++i], &lock_timeout_ns)) {
+        fprintf(stderr, "error: invalid duration '%s', e.g. \"500ms\" or \"2s\".\n", argv[i]);
+        return -1;
+      }
+      continue;
+    } else if (!strcmp(argv[i], "--all")) {
+      selector->all = true;
+    } else if (!strcmp(argv[i], "--serial") && i + 1 < argc) {
+      selector->serial = argv[++i];
+    } else if (!strcmp(argv[i], "--index") && i + 1 < argc) {
+      char* last = NULL;
+      long index = strtol(argv[++i], &last, /* base= */ 10);
+      if (last == argv[i] || *last || index < 0 || index >= MAX_DISPLAYS) {
+        fprintf(stderr, "error: invalid display index '%s'.\n", argv[i]);
+        return -1;
+      }
+      selector->index = index;
+    } else {
+      break;
+    }
+    ++criteria;
+  }
+
+  if (criteria > 1) {
+    fprintf(stderr, "error: '--all', '--serial' and '--index' are mutually exclusive.\n");
+    return -1;
+  }
+  return i;
 }
 
 int main(int argc, char* argv[]) {
@@ -390,7 +821,28 @@ int main(int argc, char* argv[]) {
     return ERR_INVALID_PRECONDITION;
   }
 
-  if (argc < 2 || argc > 3) {
+  struct global_options options;
+  int command = parse_global_options(argc, argv, &options);
+  if (command < 0) {
+    return ERR_INVALID_ARGUMENT;
+  }
+  struct display_selector selector = options.selector;
+
+  if (options.trace_path && !trace_start(options.trace_path)) {
+    fprintf(stderr, "error: failed to enable tracing.\n");
+    return ERR_INVALID_PRECONDITION;
+  }
+  if (options.stats) {
+    statistics_enabled = true;
+    atexit(print_statistics);
+  }
+
+  // Drop the global and display selection options, keeping the program name.
+  argv[command - 1] = argv[0];
+  argv += command - 1;
+  argc -= command - 1;
+
+  if (argc < 2) {
     fprintf(stderr, "error: invalid parameters\n");
     print_usage(argv[0]);
     return ERR_INVALID_ARGUMENT;
@@ -402,19 +854,35 @@ int main(int argc, char* argv[]) {
     return SUCCESS;
   }
 
-  // <program> get [-%]
+  // <program> get [-%] [--cached]
   if (!strcmp(argv[1], "get")) {
-    if (argc == 3 && strcmp(argv[2], "-%") && strcmp(argv[2], "-p") &&
-        strcmp(argv[2], "--percent")) {
-      fprintf(stderr, "error: unknown parameter '-%%' for command 'get'.\n");
-      print_usage(argv[0]);
+    bool as_percentage_point = false;
+    bool cached = false;
+
+    for (int i = 2; i < argc; ++i) {
+      if (!strcmp(argv[i], "-%") || !strcmp(argv[i], "-p") || !strcmp(argv[i], "--percent")) {
+        as_percentage_point = true;
+      } else if (!strcmp(argv[i], "--cached")) {
+        cached = true;
+      } else {
+        fprintf(stderr, "error: unknown parameter '%s' for command 'get'.\n", argv[i]);
+        print_usage(argv[0]);
+        return ERR_INVALID_ARGUMENT;
+      }
+    }
+    if (cached && (selector.all || selector.serial || selector.index >= 0)) {
+      fprintf(stderr, "error: '--cached' reads the display of the daemon, the default display.\n");
       return ERR_INVALID_ARGUMENT;
     }
-    bool as_percentage_point = argc == 3;
-    return print_brightness(as_percentage_point);
+
+    // Without a running daemon, read the display instead.
+    if (cached && print_cached_brightness(as_percentage_point)) {
+      return SUCCESS;
+    }
+    return print_brightness(&selector, as_percentage_point);
   }
 
-  // <program> set <value>
+  // <program> set <value> [--fade <duration> [--curve <curve>]] [--sync] [--verify] [--force]
   if (!strcmp(argv[1], "set")) {
     if (argc < 3) {
       fprintf(stderr, "error: 'set' command requires a value argument.\n");
@@ -433,7 +901,186 @@ int main(int argc, char* argv[]) {
       return ERR_INVALID_ARGUMENT;
     }
 
-    return set_brightness(brightness, as_percentage_point);
+    uint64_t fade_duration_ns = 0;
+    enum fade_curve curve = FADE_CURVE_LINEAR;
+    bool fade = false;
+    bool synchronized = false;
+    bool verify = false;
+
+    for (int i = 3; i < argc; ++i) {
+      if (!strcmp(argv[i], "--fade") && i + 1 < argc) {
+        if (!parse_duration(argv[++i], &fade_duration_ns)) {
+          fprintf(stderr, "error: invalid duration '%s', e.g. \"500ms\" or \"2s\".\n", argv[i]);
+          return ERR_INVALID_ARGUMENT;
+        }
+        fade = true;
+      } else if (!strcmp(argv[i], "--sync")) {
+        synchronized = true;
+      } else if (!strcmp(argv[i], "--verify")) {
+        verify = true;
+      } else if (!strcmp(argv[i], "--force")) {
+        // Accepted so that apdbctl-client can fall back to this program with the same arguments:
+        // a single invocation always sends the value, only the daemon skips unchanged values.
+      } else if (!strcmp(argv[i], "--curve") && i + 1 < argc) {
+        if (!parse_fade_curve(argv[++i], &curve)) {
+          fprintf(stderr, "error: invalid curve '%s'. Must be linear, ease or perceptual.\n",
+                  argv[i]);
+          return ERR_INVALID_ARGUMENT;
+        }
+      } else {
+        fprintf(stderr, "error: unknown parameter '%s' for command 'set'.\n", argv[i]);
+        print_usage(argv[0]);
+        return ERR_INVALID_ARGUMENT;
+      }
+    }
+
+    if (!fade && curve != FADE_CURVE_LINEAR) {
+      fprintf(stderr, "error: '--curve' requires '--fade'.\n");
+      return ERR_INVALID_ARGUMENT;
+    }
+
+    return set_brightness(&selector, brightness, as_percentage_point, fade_duration_ns, curve,
+                          synchronized, verify);
+  }
+
+  // <program> watch [-%] [--json]
+  if (!strcmp(argv[1], "watch")) {
+    bool as_percentage_point = false;
+    bool json = false;
+
+    for (int i = 2; i < argc; ++i) {
+      if (!strcmp(argv[i], "-%") || !strcmp(argv[i], "-p") || !strcmp(argv[i], "--percent")) {
+        as_percentage_point = true;
+      } else if (!strcmp(argv[i], "--json")) {
+        json = true;
+      } else {
+        fprintf(stderr, "error: unknown parameter '%s' for command 'watch'.\n", argv[i]);
+        print_usage(argv[0]);
+        return ERR_INVALID_ARGUMENT;
+      }
+    }
+    if (selector.all) {
+      fprintf(stderr, "error: 'watch' operates on a single display.\n");
+      return ERR_INVALID_ARGUMENT;
+    }
+
+    return watch_brightness(&selector, as_percentage_point, json);
+  }
+
+  // <program> wait [--timeout <duration>] [--then set <value>]
+  if (!strcmp(argv[1], "wait")) {
+    uint64_t timeout_ns = UINT64_MAX;
+    bool set = false;
+    uint32_t brightness = 0;
+
+    for (int i = 2; i < argc; ++i) {
+      if (!strcmp(argv[i], "--timeout") && i + 1 < argc) {
+        if (!parse_duration(argv[++i], &timeout_ns)) {
+          fprintf(stderr, "error: invalid duration '%s', e.g. \"500ms\" or \"2s\".\n", argv[i]);
+          return ERR_INVALID_ARGUMENT;
+        }
+      } else if (!strcmp(argv[i], "--then") && i + 2 < argc && !strcmp(argv[i + 1], "set")) {
+        bool as_percentage_point;
+        if (!parse_brightness_parameter(argv[i + 2], &brightness, &as_percentage_point)) {
+          fprintf(stderr,
+                  "error: invalid brightness value '%s'. Must be a valid integer (in [%u, %u]) or "
+                  "percentage [0%%, 100%%].\n",
+                  argv[i + 2], BRIGHTNESS_MIN, BRIGHTNESS_MAX);
+          return ERR_INVALID_ARGUMENT;
+        }
+        if (as_percentage_point) {
+          brightness = to_absolute_brightness(brightness);
+        }
+        set = true;
+        i += 2;
+      } else {
+        fprintf(stderr, "error: unknown parameter '%s' for command 'wait'.\n", argv[i]);
+        print_usage(argv[0]);
+        return ERR_INVALID_ARGUMENT;
+      }
+    }
+    if (selector.all) {
+      fprintf(stderr, "error: 'wait' operates on a single display.\n");
+      return ERR_INVALID_ARGUMENT;
+    }
+
+    return wait_for_device(&selector, timeout_ns, set, brightness);
+  }
+
+  // <program> list
+  if (!strcmp(argv[1], "list")) {
+    if (argc > 2) {
+      fprintf(stderr, "error: invalid parameters\n");
+      print_usage(argv[0]);
+      return ERR_INVALID_ARGUMENT;
+    }
+    return list_displays();
+  }
+
+  // <program> batch [file]
+  if (!strcmp(argv[1], "batch")) {
+    if (argc > 3) {
+      fprintf(stderr, "error: invalid parameters\n");
+      print_usage(argv[0]);
+      return ERR_INVALID_ARGUMENT;
+    }
+    if (selector.all) {
+      fprintf(stderr, "error: 'batch' operates on a single display.\n");
+      return ERR_INVALID_ARGUMENT;
+    }
+
+    FILE* input = stdin;
+    if (argc == 3 && strcmp(argv[2], "-") && !(input = fopen(argv[2], "r"))) {
+      fprintf(stderr, "error: failed to open '%s': %s\n", argv[2], strerror(errno));
+      return ERR_INVALID_ARGUMENT;
+    }
+
+    int status = run_batch(&selector, input, lock_timeout_ns);
+    if (input != stdin) {
+      fclose(input);
+    }
+    return status;
+  }
+
+  // <program> bench [--iterations <n>] [--mode <mode>]... [--json]
+  if (!strcmp(argv[1], "bench")) {
+    struct bench_options bench = {.iterations = 100, .program = argv[0]};
+
+    for (int i = 2; i < argc; ++i) {
+      if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+        char* last = NULL;
+        long iterations = strtol(argv[++i], &last, /* base= */ 10);
+        if (last == argv[i] || *last || iterations <= 0 || iterations > 1000000) {
+          fprintf(stderr, "error: invalid number of iterations '%s'.\n", argv[i]);
+          return ERR_INVALID_ARGUMENT;
+        }
+        bench.iterations = iterations;
+      } else if (!strcmp(argv[i], "--mode") && i + 1 < argc) {
+        unsigned int mode;
+        if (!parse_bench_mode(argv[++i], &mode)) {
+          fprintf(stderr,
+                  "error: invalid mode '%s'. Must be phases, warm, cold, daemon, spawn or all.\n",
+                  argv[i]);
+          return ERR_INVALID_ARGUMENT;
+        }
+        bench.modes |= mode;
+      } else if (!strcmp(argv[i], "--json")) {
+        bench.json = true;
+      } else {
+        fprintf(stderr, "error: unknown parameter '%s' for command 'bench'.\n", argv[i]);
+        print_usage(argv[0]);
+        return ERR_INVALID_ARGUMENT;
+      }
+    }
+    if (selector.all) {
+      fprintf(stderr, "error: 'bench' operates on a single display.\n");
+      return ERR_INVALID_ARGUMENT;
+    }
+    if (!bench.modes) {
+      bench.modes = BENCH_MODE_PHASES | BENCH_MODE_WARM | BENCH_MODE_COLD;
+    }
+
+    return run_bench(&selector, &bench);
   }
 
   fprintf(stderr, "error: unknown command '%s'\n", argv[1]);
@@ -0,0 +1,455 @@
+// Simulated hidapi backend.
+//
+// Emulates Apple Pro Display XDR monitors, each advertising 4 HID interfaces of which only one
+// controls the brightness, among any number of unrelated HID devices. Behavior is configured with
+// environment variables, read once:
+//
+//   APDBCTL_MOCK_DISPLAYS               Number of Pro Display XDR monitors (default: 1).
+//   APDBCTL_MOCK_EXTRA_DEVICES          Number of unrelated HID devices (default: 0).
+//   APDBCTL_MOCK_LATENCY_US             Latency of each device I/O call (default: 0).
+//   APDBCTL_MOCK_ENUMERATE_LATENCY_US   Latency per device listed by hid_enumerate (default: 0).
+//   APDBCTL_MOCK_FAILURE_RATE           Probability in [0, 1] that a device I/O call fails
+//                                       (default: 0).
+//   APDBCTL_MOCK_INPUT_INTERVAL_MS      Interval between spontaneous brightness changes reported
+//                                       through input reports, or 0 for none (default: 0).
+//   APDBCTL_MOCK_SETTLE_MS              Delay before a brightness that was set is applied and
+//                                       reported, as a panel ramping to it (default: 0).
+//   APDBCTL_MOCK_SEED                   Seed of the failure generator (default: 1).
+//
+// State is held in-process: the brightness set by one process is not seen by another.
+
+#include "hidapi.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MOCK_MAX_DISPLAYS 16
+#define MOCK_INTERFACES_PER_DISPLAY 4
+#define MOCK_BRIGHTNESS_INTERFACE 1
+#define MOCK_BRIGHTNESS_REPORT_ID 0x1
+#define MOCK_BRIGHTNESS_INITIAL 0x61a8  // 25_000
+#define MOCK_APPLE_INC 0x05ac
+#define MOCK_PRO_DISPLAY_XDR 0x9243
+#define MOCK_OTHER_VENDOR 0x046d
+#define MOCK_OTHER_PRODUCT 0xc52b
+
+// Brightness control interface, as documented in README.md.
+static const unsigned char brightness_descriptor[] = {
+    0x05, 0x80, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x01, 0x06, 0x82, 0x00, 0x09, 0x10, 0x16,
+    0x90, 0x01, 0x27, 0x50, 0xC3, 0x00, 0x00, 0x67, 0xE1, 0x00, 0x00, 0x01, 0x55, 0x0E,
+    0x75, 0x20, 0x95, 0x01, 0xB1, 0x42, 0x05, 0x0F, 0x09, 0x50, 0x15, 0x00, 0x26, 0x20,
+    0x4E, 0x66, 0x10, 0x01, 0x55, 0x0D, 0x75, 0x10, 0xB1, 0x42, 0x06, 0x82, 0x00, 0x09,
+    0x10, 0x16, 0x90, 0x01, 0x27, 0x50, 0xC3, 0x00, 0x00, 0x67, 0xE1, 0x00, 0x00, 0x01,
+    0x55, 0x0E, 0x75, 0x20, 0x95, 0x01, 0x81, 0x02, 0xC0,
+};
+
+// Other interfaces of the display: a vendor-defined page.
+static const unsigned char vendor_descriptor[] = {
+    0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x02, 0x15, 0x00, 0x26, 0xFF, 0x00,
+    0x75, 0x08, 0x95, 0x3F, 0x09, 0x01, 0xB1, 0x02, 0x85, 0x03, 0x09, 0x02, 0x95, 0x3F,
+    0x81, 0x02, 0x85, 0x04, 0x09, 0x03, 0x95, 0x3F, 0x91, 0x02, 0xC0,
+};
+
+// Unrelated devices: a boot keyboard.
+static const unsigned char keyboard_descriptor[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00,
+    0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65,
+    0x81, 0x00, 0xC0,
+};
+
+/**
+ * @brief Simulation parameters, read from the environment.
+ */
+struct mock_configuration {
+  unsigned int displays;
+  unsigned int extra_devices;
+  unsigned int latency_us;
+  unsigned int enumerate_latency_us;
+  double failure_rate;
+  unsigned int input_interval_ms;
+  unsigned int settle_ms;
+  unsigned int seed;
+};
+
+/**
+ * @brief Simulated state of a display, shared by all handles.
+ *
+ * @param brightness The current absolute brightness.
+ * @param next_change_ns When to change the brightness spontaneously, if enabled.
+ * @param pending_brightness The brightness set last, applied at `pending_ns`.
+ * @param pending_ns When the panel applies `pending_brightness`, or 0 if nothing is pending.
+ */
+struct mock_display {
+  uint32_t brightness;
+  uint64_t next_change_ns;
+  uint32_t pending_brightness;
+  uint64_t pending_ns;
+};
+
+struct hid_device_ {
+  unsigned int display;
+  int interface;
+  unsigned int seed;
+  uint32_t reported_brightness;
+  wchar_t error[128];
+};
+
+static struct mock_configuration configuration;
+static struct mock_display displays[MOCK_MAX_DISPLAYS];
+static pthread_once_t initialized = PTHREAD_ONCE_INIT;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+static wchar_t global_error[128] = L"Success";
+
+static unsigned int mock_getenv(const char* name, unsigned int fallback) {
+  const char* value = getenv(name);
+  return value && *value ? (unsigned int)strtoul(value, NULL, 10) : fallback;
+}
+
+static uint64_t mock_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static void mock_sleep_us(unsigned int microseconds) {
+  struct timespec duration = {
+      .tv_sec = microseconds / 1000000,
+      .tv_nsec = (microseconds % 1000000) * 1000l,
+  };
+  while (microseconds && nanosleep(&duration, &duration) && errno == EINTR) {
+  }
+}
+
+static void mock_initialize(void) {
+  configuration.displays = mock_getenv("APDBCTL_MOCK_DISPLAYS", 1);
+  if (configuration.displays > MOCK_MAX_DISPLAYS) {
+    configuration.displays = MOCK_MAX_DISPLAYS;
+  }
+  configuration.extra_devices = mock_getenv("APDBCTL_MOCK_EXTRA_DEVICES", 0);
+  configuration.latency_us = mock_getenv("APDBCTL_MOCK_LATENCY_US", 0);
+  configuration.enumerate_latency_us = mock_getenv("APDBCTL_MOCK_ENUMERATE_LATENCY_US", 0);
+  configuration.input_interval_ms = mock_getenv("APDBCTL_MOCK_INPUT_INTERVAL_MS", 0);
+  configuration.settle_ms = mock_getenv("APDBCTL_MOCK_SETTLE_MS", 0);
+  configuration.seed = mock_getenv("APDBCTL_MOCK_SEED", 1);
+
+  const char* failure_rate = getenv("APDBCTL_MOCK_FAILURE_RATE");
+  configuration.failure_rate = failure_rate ? strtod(failure_rate, NULL) : 0.0;
+
+  uint64_t now_ns = mock_now_ns();
+  for (unsigned int i = 0; i < MOCK_MAX_DISPLAYS; ++i) {
+    displays[i].brightness = MOCK_BRIGHTNESS_INITIAL;
+    displays[i].next_change_ns = now_ns + configuration.input_interval_ms * 1000000ull;
+  }
+}
+
+/**
+ * @brief Simulates the latency and failures of a device I/O call.
+ *
+ * @param dev[in,out] The device.
+ * @return Whether the call succeeds.
+ */
+static bool mock_io(hid_device* dev) {
+  mock_sleep_us(configuration.latency_us);
+  if (configuration.failure_rate > 0 &&
+      rand_r(&dev->seed) < configuration.failure_rate * ((double)RAND_MAX + 1)) {
+    swprintf(dev->error, sizeof(dev->error) / sizeof(*dev->error), L"Simulated failure");
+    return false;
+  }
+  swprintf(dev->error, sizeof(dev->error) / sizeof(*dev->error), L"Success");
+  return true;
+}
+
+/**
+ * @brief Applies the brightness set last, once the panel had time to settle. Must be called with
+ * the mutex locked.
+ */
+static void mock_settle(struct mock_display* display, uint64_t now_ns) {
+  if (display->pending_ns && now_ns >= display->pending_ns) {
+    display->brightness = display->pending_brightness;
+    display->pending_ns = 0;
+    pthread_cond_broadcast(&changed);
+  }
+}
+
+static bool mock_is_brightness_interface(const hid_device* dev) {
+  return dev->interface == MOCK_BRIGHTNESS_INTERFACE;
+}
+
+int hid_init(void) {
+  pthread_once(&initialized, mock_initialize);
+  return 0;
+}
+
+int hid_exit(void) { return 0; }
+
+static struct hid_device_info* mock_device_info(const char* path, unsigned short vendor_id,
+                                                unsigned short product_id, const wchar_t* serial,
+                                                int interface_number) {
+  struct hid_device_info* info = calloc(1, sizeof(*info));
+  info->path = strdup(path);
+  info->vendor_id = vendor_id;
+  info->product_id = product_id;
+  info->serial_number = wcsdup(serial);
+  info->manufacturer_string = wcsdup(vendor_id == MOCK_APPLE_INC ? L"Apple Inc." : L"Mock");
+  info->product_string = wcsdup(vendor_id == MOCK_APPLE_INC ? L"Pro Display XDR" : L"Keyboard");
+  info->interface_number = interface_number;
+  info->bus_type = HID_API_BUS_USB;
+  return info;
+}
+
+struct hid_device_info* hid_enumerate(unsigned short vendor_id, unsigned short product_id) {
+  hid_init();
+
+  struct hid_device_info* head = NULL;
+  struct hid_device_info** tail = &head;
+  char path[64];
+  wchar_t serial[32];
+
+  // Unrelated devices come first, as the worst case for a linear scan.
+  for (unsigned int i = 0; i < configuration.extra_devices; ++i) {
+    mock_sleep_us(configuration.enumerate_latency_us);
+    if ((vendor_id && vendor_id != MOCK_OTHER_VENDOR) ||
+        (product_id && product_id != MOCK_OTHER_PRODUCT)) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "mock:device%u", i);
+    swprintf(serial, sizeof(serial) / sizeof(*serial), L"%08u", i);
+    *tail = mock_device_info(path, MOCK_OTHER_VENDOR, MOCK_OTHER_PRODUCT, serial, 0);
+    tail = &(*tail)->next;
+  }
+
+  for (unsigned int display = 0; display < configuration.displays; ++display) {
+    for (int interface = 0; interface < MOCK_INTERFACES_PER_DISPLAY; ++interface) {
+      mock_sleep_us(configuration.enumerate_latency_us);
+      if ((vendor_id && vendor_id != MOCK_APPLE_INC) ||
+          (product_id && product_id != MOCK_PRO_DISPLAY_XDR)) {
+        continue;
+      }
+      snprintf(path, sizeof(path), "mock:display%u.%d", display, interface);
+      swprintf(serial, sizeof(serial) / sizeof(*serial), L"MOCK%08u", display);
+      *tail = mock_device_info(path, MOCK_APPLE_INC, MOCK_PRO_DISPLAY_XDR, serial, interface);
+      tail = &(*tail)->next;
+    }
+  }
+
+  return head;
+}
+
+void hid_free_enumeration(struct hid_device_info* devs) {
+  while (devs) {
+    struct hid_device_info* next = devs->next;
+    free(devs->path);
+    free(devs->serial_number);
+    free(devs->manufacturer_string);
+    free(devs->product_string);
+    free(devs);
+    devs = next;
+  }
+}
+
+hid_device* hid_open_path(const char* path) {
+  hid_init();
+
+  unsigned int display;
+  int interface;
+  unsigned int device;
+  hid_device* dev = calloc(1, sizeof(*dev));
+  dev->seed = configuration.seed;
+
+  if (sscanf(path, "mock:display%u.%d", &display, &interface) == 2 &&
+      display < configuration.displays && interface >= 0 &&
+      interface < MOCK_INTERFACES_PER_DISPLAY) {
+    dev->display = display;
+    dev->interface = interface;
+  } else if (sscanf(path, "mock:device%u", &device) == 1 &&
+             device < configuration.extra_devices) {
+    dev->interface = -1;
+  } else {
+    swprintf(global_error, sizeof(global_error) / sizeof(*global_error), L"No such device");
+    free(dev);
+    return NULL;
+  }
+
+  if (!mock_io(dev)) {
+    swprintf(global_error, sizeof(global_error) / sizeof(*global_error), L"%ls", dev->error);
+    free(dev);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&mutex);
+  dev->reported_brightness = displays[dev->display].brightness;
+  pthread_mutex_unlock(&mutex);
+  return dev;
+}
+
+void hid_close(hid_device* dev) { free(dev); }
+
+int hid_read_timeout(hid_device* dev, unsigned char* data, size_t length, int milliseconds) {
+  if (!mock_is_brightness_interface(dev)) {
+    // Other interfaces never report anything.
+    if (milliseconds < 0) {
+      for (;;) {
+        mock_sleep_us(1000000);
+      }
+    }
+    mock_sleep_us(milliseconds * 1000u);
+    return 0;
+  }
+
+  uint64_t deadline_ns = milliseconds < 0 ? UINT64_MAX : mock_now_ns() + milliseconds * 1000000ull;
+  struct mock_display* display = &displays[dev->display];
+
+  pthread_mutex_lock(&mutex);
+  for (;;) {
+    uint64_t now_ns = mock_now_ns();
+    mock_settle(display, now_ns);
+    if (configuration.input_interval_ms && now_ns >= display->next_change_ns) {
+      // Emulate the brightness buttons, or ambient light adaptation.
+      display->brightness = 400 + (display->brightness + 4960) % 49600;
+      display->next_change_ns = now_ns + configuration.input_interval_ms * 1000000ull;
+      pthread_cond_broadcast(&changed);
+    }
+
+    if (display->brightness != dev->reported_brightness) {
+      break;
+    }
+    if (now_ns >= deadline_ns) {
+      pthread_mutex_unlock(&mutex);
+      return 0;
+    }
+
+    uint64_t wake_ns = deadline_ns;
+    if (configuration.input_interval_ms && display->next_change_ns < wake_ns) {
+      wake_ns = display->next_change_ns;
+    }
+    if (display->pending_ns && display->pending_ns < wake_ns) {
+      wake_ns = display->pending_ns;
+    }
+    if (wake_ns == UINT64_MAX) {
+      pthread_cond_wait(&changed, &mutex);
+    } else {
+      // The condition variable uses the realtime clock: convert the monotonic deadline.
+      struct timespec wake;
+      clock_gettime(CLOCK_REALTIME, &wake);
+      uint64_t wake_realtime_ns =
+          (uint64_t)wake.tv_sec * 1000000000ull + wake.tv_nsec + (wake_ns - now_ns);
+      wake.tv_sec = wake_realtime_ns / 1000000000ull;
+      wake.tv_nsec = wake_realtime_ns % 1000000000ull;
+      pthread_cond_timedwait(&changed, &mutex, &wake);
+    }
+  }
+
+  uint32_t brightness = display->brightness;
+  dev->reported_brightness = brightness;
+  pthread_mutex_unlock(&mutex);
+
+  unsigned char report[] = {
+      MOCK_BRIGHTNESS_REPORT_ID, brightness & 0xff, brightness >> 8 & 0xff,
+      brightness >> 16 & 0xff,   brightness >> 24,
+  };
+  size_t size = length < sizeof(report) ? length : sizeof(report);
+  memcpy(data, report, size);
+  return (int)size;
+}
+
+int hid_read(hid_device* dev, unsigned char* data, size_t length) {
+  return hid_read_timeout(dev, data, length, -1);
+}
+
+int hid_send_feature_report(hid_device* dev, const unsigned char* data, size_t length) {
+  if (!mock_io(dev)) {
+    return -1;
+  }
+  if (!mock_is_brightness_interface(dev) || length < 5 || data[0] != MOCK_BRIGHTNESS_REPORT_ID) {
+    swprintf(dev->error, sizeof(dev->error) / sizeof(*dev->error), L"Invalid feature report");
+    return -1;
+  }
+
+  uint32_t brightness =
+      data[1] | (uint32_t)data[2] << 8 | (uint32_t)data[3] << 16 | (uint32_t)data[4] << 24;
+  struct mock_display* display = &displays[dev->display];
+
+  pthread_mutex_lock(&mutex);
+  if (!configuration.settle_ms) {
+    display->brightness = brightness;
+    pthread_cond_broadcast(&changed);
+  } else if (!display->pending_ns || display->pending_brightness != brightness) {
+    // Sending the pending value again does not restart the transition.
+    display->pending_brightness = brightness;
+    display->pending_ns = mock_now_ns() + configuration.settle_ms * 1000000ull;
+  }
+  pthread_mutex_unlock(&mutex);
+  return (int)length;
+}
+
+int hid_get_feature_report(hid_device* dev, unsigned char* data, size_t length) {
+  if (!mock_io(dev)) {
+    return -1;
+  }
+  if (!mock_is_brightness_interface(dev) || length < 5 || data[0] != MOCK_BRIGHTNESS_REPORT_ID) {
+    swprintf(dev->error, sizeof(dev->error) / sizeof(*dev->error), L"Invalid feature report");
+    return -1;
+  }
+
+  pthread_mutex_lock(&mutex);
+  mock_settle(&displays[dev->display], mock_now_ns());
+  uint32_t brightness = displays[dev->display].brightness;
+  pthread_mutex_unlock(&mutex);
+
+  memset(data + 1, 0, length - 1);
+  data[1] = brightness & 0xff;
+  data[2] = brightness >> 8 & 0xff;
+  data[3] = brightness >> 16 & 0xff;
+  data[4] = brightness >> 24;
+  return (int)length;
+}
+
+int hid_get_serial_number_string(hid_device* dev, wchar_t* string, size_t maxlen) {
+  if (dev->interface < 0) {
+    swprintf(string, maxlen, L"");
+  } else {
+    swprintf(string, maxlen, L"MOCK%08u", dev->display);
+  }
+  return 0;
+}
+
+int hid_get_report_descriptor(hid_device* dev, unsigned char* buf, size_t buf_size) {
+  if (!mock_io(dev)) {
+    return -1;
+  }
+
+  const unsigned char* descriptor = keyboard_descriptor;
+  size_t size = sizeof(keyboard_descriptor);
+  if (mock_is_brightness_interface(dev)) {
+    descriptor = brightness_descriptor;
+    size = sizeof(brightness_descriptor);
+  } else if (dev->interface >= 0) {
+    descriptor = vendor_descriptor;
+    size = sizeof(vendor_descriptor);
+  }
+
+  size = buf_size < size ? buf_size : size;
+  memcpy(buf, descriptor, size);
+  return (int)size;
+}
+
+const wchar_t* hid_error(hid_device* dev) { return dev ? dev->error : global_error; }
+
+const struct hid_api_version* hid_version(void) {
+  static const struct hid_api_version version = {
+      .major = HID_API_VERSION_MAJOR,
+      .minor = HID_API_VERSION_MINOR,
+      .patch = HID_API_VERSION_PATCH,
+  };
+  return &version;
+}
+
+const char* hid_version_str(void) { return "0.14.0-mock"; }
@@ -0,0 +1,60 @@
+#ifndef APDBCTL_MOCK_HIDAPI_H
+#define APDBCTL_MOCK_HIDAPI_H
+
+// Subset of the hidapi API used by apdbctl, implemented by a simulated set of devices. Signatures
+// match hidapi 0.14 so that the code building against it is unchanged.
+
+#include <stddef.h>
+#include <wchar.h>
+
+#define HID_API_VERSION_MAJOR 0
+#define HID_API_VERSION_MINOR 14
+#define HID_API_VERSION_PATCH 0
+
+#define HID_API_MAX_REPORT_DESCRIPTOR_SIZE 4096
+
+struct hid_api_version {
+  int major;
+  int minor;
+  int patch;
+};
+
+typedef struct hid_device_ hid_device;
+
+typedef enum {
+  HID_API_BUS_UNKNOWN = 0x00,
+  HID_API_BUS_USB = 0x01,
+} hid_bus_type;
+
+struct hid_device_info {
+  char* path;
+  unsigned short vendor_id;
+  unsigned short product_id;
+  wchar_t* serial_number;
+  unsigned short release_number;
+  wchar_t* manufacturer_string;
+  wchar_t* product_string;
+  unsigned short usage_page;
+  unsigned short usage;
+  int interface_number;
+  struct hid_device_info* next;
+  hid_bus_type bus_type;
+};
+
+int hid_init(void);
+int hid_exit(void);
+struct hid_device_info* hid_enumerate(unsigned short vendor_id, unsigned short product_id);
+void hid_free_enumeration(struct hid_device_info* devs);
+hid_device* hid_open_path(const char* path);
+void hid_close(hid_device* dev);
+int hid_read_timeout(hid_device* dev, unsigned char* data, size_t length, int milliseconds);
+int hid_read(hid_device* dev, unsigned char* data, size_t length);
+int hid_send_feature_report(hid_device* dev, const unsigned char* data, size_t length);
+int hid_get_feature_report(hid_device* dev, unsigned char* data, size_t length);
+int hid_get_serial_number_string(hid_device* dev, wchar_t* string, size_t maxlen);
+int hid_get_report_descriptor(hid_device* dev, unsigned char* buf, size_t buf_size);
+const wchar_t* hid_error(hid_device* dev);
+const struct hid_api_version* hid_version(void);
+const char* hid_version_str(void);
+
+#endif  // APDBCTL_MOCK_HIDAPI_H
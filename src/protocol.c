@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+
+#include "protocol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "runtime.h"
+
+#define DAEMON_PROGRAM PROJECT_NAME "d"
+#define DAEMON_SPAWN_LOCK_NAME "apdbctld.lock"
+#define DAEMON_SPAWN_TIMEOUT_NS (2 * NANOSECONDS_PER_SECOND)
+#define DAEMON_SPAWN_MIN_POLL_NS 500000ull
+#define DAEMON_SPAWN_MAX_POLL_NS 8000000ull
+
+extern char** environ;
+
+/**
+ * @brief Builds the path of the daemon socket.
+ *
+ * @param buffer[out] The buffer to write the path to.
+ * @param size[in] The size of `buffer`.
+ * @param create_directory[in] Whether to create the runtime directory if it does not exist.
+ *
+ * @retval true Path written to `buffer`.
+ * @retval false The path could not be built.
+ * @see runtime_path
+ */
+bool daemon_socket_path(char* buffer, size_t size, bool create_directory) {
+  return runtime_path(buffer, size, DAEMON_SOCKET_NAME, create_directory);
+}
+
+/**
+ * @brief Connects to the daemon socket.
+ *
+ * @retval >=0 The connected socket.
+ * @retval -1 No daemon is listening, `errno` is set accordingly.
+ */
+int daemon_connect(void) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (!daemon_socket_path(address.sun_path, sizeof(address.sun_path),
+                          /* create_directory= */ false)) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+
+  return fd;
+}
+
+/**
+ * @brief Takes the lock serializing daemon spawns, waiting for the current holder.
+ *
+ * Held by clients while they spawn a daemon and wait for its socket, and by a daemon exiting on
+ * idle while it releases its socket and status page, so that at most one daemon is started at a
+ * time and a new one never races the teardown of the previous one.
+ *
+ * @retval >=0 The lock, released by closing it.
+ * @retval -1 The runtime directory is unavailable.
+ */
+int daemon_spawn_lock(void) {
+  char path[PATH_MAX];
+  if (!runtime_path(path, sizeof(path), DAEMON_SPAWN_LOCK_NAME, /* create_directory= */ true)) {
+    return -1;
+  }
+  // Close-on-exec, so that the spawned daemon does not inherit the lock.
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return -1;
+  }
+  while (flock(fd, LOCK_EX) < 0 && errno == EINTR) {
+  }
+  return fd;
+}
+
+/**
+ * @brief Starts the daemon in a new session, detached from the standard streams.
+ *
+ * @param idle_timeout[in] The idle period after which the daemon exits, e.g. "300s".
+ * @return The process ID of the daemon, or -1 if it could not be executed.
+ */
+static pid_t daemon_spawn(const char* idle_timeout) {
+  char* argv[] = {DAEMON_PROGRAM, "--idle-timeout", (char*)idle_timeout, NULL};
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; ++fd) {
+    posix_spawn_file_actions_addopen(&actions, fd, "/dev/null", fd ? O_WRONLY : O_RDONLY, 0);
+  }
+  posix_spawnattr_t attributes;
+  posix_spawnattr_init(&attributes);
+  posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSID);
+
+  pid_t pid;
+  int error = posix_spawnp(&pid, DAEMON_PROGRAM, &actions, &attributes, argv, environ);
+  posix_spawnattr_destroy(&attributes);
+  posix_spawn_file_actions_destroy(&actions);
+  return error ? -1 : pid;
+}
+
+/**
+ * @brief Connects to the daemon, starting it first if none is running.
+ *
+ * The daemon is spawned under `daemon_spawn_lock`, so that concurrent clients start a single
+ * daemon and the others connect to it. The socket is polled until the daemon listens, which it
+ * does before opening the display.
+ *
+ * @param idle_timeout[in] The idle period after which a spawned daemon exits, e.g. "300s".
+ * @param pid[out] The process ID of the spawned daemon, or -1 if one was already running or none
+ *   was started.
+ *
+ * @retval >=0 The connected socket.
+ * @retval -1 No daemon could be started, or it did not listen within `DAEMON_SPAWN_TIMEOUT_NS` and
+ *   was terminated.
+ */
+int daemon_connect_or_spawn(const char* idle_timeout, pid_t* pid) {
+  *pid = -1;
+  int fd = daemon_connect();
+  if (fd >= 0) {
+    return fd;
+  }
+
+  int lock = daemon_spawn_lock();
+  if (lock < 0) {
+    return -1;
+  }
+
+  // Another client may have started the daemon while this one waited for the lock.
+  fd = daemon_connect();
+  if (fd < 0) {
+    *pid = daemon_spawn(idle_timeout);
+  }
+
+  uint64_t start_ns = monotonic_ns();
+  uint64_t poll_ns = DAEMON_SPAWN_MIN_POLL_NS;
+  while (fd < 0 && *pid > 0) {
+    uint64_t now_ns = monotonic_ns();
+    if (waitpid(*pid, NULL, WNOHANG) == *pid) {
+      // The daemon failed, e.g. with an invalid idle timeout.
+      *pid = -1;
+      break;
+    }
+    if (now_ns - start_ns >= DAEMON_SPAWN_TIMEOUT_NS) {
+      // The daemon is stuck. Stop it, so that it does not open the display after the caller fell
+      // back to opening it itself.
+      kill(*pid, SIGTERM);
+      while (waitpid(*pid, NULL, 0) < 0 && errno == EINTR) {
+      }
+      *pid = -1;
+      break;
+    }
+    sleep_until(now_ns + poll_ns);
+    poll_ns = poll_ns * 2 < DAEMON_SPAWN_MAX_POLL_NS ? poll_ns * 2 : DAEMON_SPAWN_MAX_POLL_NS;
+    fd = daemon_connect();
+  }
+
+  close(lock);
+  return fd;
+}
+
+/**
+ * @brief Sends a request to the daemon and waits for its response.
+ *
+ * @param fd[in] The socket connected to the daemon.
+ * @param request[in] The request to send.
+ * @param response[out] The response of the daemon.
+ *
+ * @retval true Response received.
+ * @retval false Failed to communicate with the daemon.
+ */
+bool daemon_call(int fd, const struct daemon_request* request, struct daemon_response* response) {
+  if (send(fd, request, sizeof(*request), MSG_NOSIGNAL) != sizeof(*request)) {
+    return false;
+  }
+
+  ssize_t bytes_read;
+  do {
+    bytes_read = recv(fd, response, sizeof(*response), 0);
+  } while (bytes_read < 0 && errno == EINTR);
+
+  return bytes_read == sizeof(*response);
+}
+
+/**
+ * @brief Requests the counters of the daemon.
+ *
+ * @param fd[in] The socket connected to the daemon.
+ * @param buffer[out] The counters, as NUL-terminated `key=value` lines.
+ * @param size[in] The size of `buffer`, at least `DAEMON_STATISTICS_SIZE + 1`.
+ *
+ * @retval true Counters received.
+ * @retval false Failed to communicate with the daemon.
+ */
+bool daemon_call_statistics(int fd, char* buffer, size_t size) {
+  const struct daemon_request request = {.command = DAEMON_COMMAND_STATS};
+  if (send(fd, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request)) {
+    return false;
+  }
+
+  ssize_t bytes_read;
+  do {
+    bytes_read = recv(fd, buffer, size - 1, 0);
+  } while (bytes_read < 0 && errno == EINTR);
+
+  if (bytes_read <= 0) {
+    return false;
+  }
+  buffer[bytes_read] = '\0';
+  return true;
+}
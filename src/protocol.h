@@ -0,0 +1,61 @@
+#ifndef APDBCTL_PROTOCOL_H
+#define APDBCTL_PROTOCOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define DAEMON_SOCKET_NAME "apdbctld.sock"
+
+#define DAEMON_COMMAND_GET 0x1
+#define DAEMON_COMMAND_SET 0x2
+#define DAEMON_COMMAND_STATS 0x3
+
+#define DAEMON_FLAG_PERCENT 0x1
+#define DAEMON_FLAG_FORCE 0x2
+
+// The maximum size of the response to `DAEMON_COMMAND_STATS`.
+#define DAEMON_STATISTICS_SIZE 1024
+
+/**
+ * @brief A request sent to the daemon.
+ *
+ * Requests and responses are exchanged as single datagrams over a `SOCK_SEQPACKET` UNIX socket,
+ * in host byte order.
+ *
+ * @param command One of `DAEMON_COMMAND_*`.
+ * @param flags A combination of `DAEMON_FLAG_*`.
+ * @param reserved Unused, must be zero.
+ * @param value The brightness value for `DAEMON_COMMAND_SET`, absolute or percentage depending on
+ *   `DAEMON_FLAG_PERCENT`.
+ */
+struct daemon_request {
+  uint8_t command;
+  uint8_t flags;
+  uint16_t reserved;
+  uint32_t value;
+};
+
+/**
+ * @brief A response sent by the daemon.
+ *
+ * `DAEMON_COMMAND_STATS` is answered with `key=value` lines of text instead, see
+ * `daemon_call_statistics`.
+ *
+ * @param status `SUCCESS` or one of `ERR_*`.
+ * @param brightness The absolute brightness value of the display after the request completed.
+ */
+struct daemon_response {
+  int32_t status;
+  uint32_t brightness;
+};
+
+bool daemon_socket_path(char* buffer, size_t size, bool create_directory);
+int daemon_connect(void);
+int daemon_spawn_lock(void);
+int daemon_connect_or_spawn(const char* idle_timeout, pid_t* pid);
+bool daemon_call(int fd, const struct daemon_request* request, struct daemon_response* response);
+bool daemon_call_statistics(int fd, char* buffer, size_t size);
+
+#endif  // APDBCTL_PROTOCOL_H
@@ -0,0 +1,39 @@
+#include "runtime.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Builds the path of a file in the per-user runtime directory.
+ *
+ * Files live under `$XDG_RUNTIME_DIR/apdbctl`. `$XDG_RUNTIME_DIR` is private to the user and wiped
+ * on logout, so stale entries never survive a reboot.
+ *
+ * @param buffer[out] The buffer to write the path to.
+ * @param size[in] The size of `buffer`.
+ * @param name[in] The name of the file within the runtime directory.
+ * @param create_directory[in] Whether to create the runtime directory if it does not exist.
+ *
+ * @retval true Path written to `buffer`.
+ * @retval false `$XDG_RUNTIME_DIR` is unset, or the path could not be built.
+ */
+bool runtime_path(char* buffer, size_t size, const char* name, bool create_directory) {
+  const char* runtime_directory = getenv("XDG_RUNTIME_DIR");
+  if (!runtime_directory || !*runtime_directory) {
+    return false;
+  }
+
+  int length = snprintf(buffer, size, "%s/%s", runtime_directory, RUNTIME_DIRECTORY);
+  if (length < 0 || (size_t)length >= size) {
+    return false;
+  }
+
+  if (create_directory && mkdir(buffer, 0700) < 0 && errno != EEXIST) {
+    return false;
+  }
+
+  length = snprintf(buffer, size, "%s/%s/%s", runtime_directory, RUNTIME_DIRECTORY, name);
+  return length >= 0 && (size_t)length < size;
+}
@@ -0,0 +1,11 @@
+#ifndef APDBCTL_RUNTIME_H
+#define APDBCTL_RUNTIME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RUNTIME_DIRECTORY "apdbctl"
+
+bool runtime_path(char* buffer, size_t size, const char* name, bool create_directory);
+
+#endif  // APDBCTL_RUNTIME_H
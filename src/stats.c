@@ -0,0 +1,130 @@
+#include "stats.h"
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#if defined(__linux__)
+#define FD_DIRECTORY "/proc/self/fd"
+#else
+#define FD_DIRECTORY "/dev/fd"
+#endif
+
+static const char* statistic_names[STAT_COUNT] = {
+    [STAT_DEVICES_ENUMERATED] = "devices_enumerated",
+    [STAT_DEVICES_OPENED] = "devices_opened",
+    [STAT_DESCRIPTOR_FETCHES] = "descriptor_fetches",
+    [STAT_DESCRIPTOR_PARSES] = "descriptor_parses",
+    [STAT_FEATURE_REPORTS_SENT] = "feature_reports_sent",
+    [STAT_FEATURE_REPORTS_RECEIVED] = "feature_reports_received",
+    [STAT_INPUT_REPORTS_RECEIVED] = "input_reports_received",
+    [STAT_BYTES_SENT] = "bytes_sent",
+    [STAT_BYTES_RECEIVED] = "bytes_received",
+    [STAT_LOCK_WAIT_NS] = "lock_wait_ns",
+};
+
+bool statistics_enabled = false;
+_Atomic uint64_t statistics[STAT_COUNT];
+
+static _Atomic size_t peak_fds;
+
+/**
+ * @brief Counts the file descriptors open in the process.
+ *
+ * @return The number of open file descriptors, or 0 if they cannot be listed.
+ */
+static size_t count_fds(void) {
+  DIR* directory = opendir(FD_DIRECTORY);
+  if (!directory) {
+    return 0;
+  }
+
+  size_t count = 0;
+  for (struct dirent* entry = readdir(directory); entry; entry = readdir(directory)) {
+    count += strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..");
+  }
+  closedir(directory);
+
+  // Leave out the descriptor of the listing itself.
+  return count ? count - 1 : 0;
+}
+
+/**
+ * @brief Updates the peak number of open file descriptors, when statistics are enabled.
+ *
+ * Called after each device is opened, which is when the number of descriptors grows.
+ */
+void statistics_sample_fds(void) {
+  if (!statistics_enabled) {
+    return;
+  }
+
+  size_t count = count_fds();
+  size_t peak = atomic_load_explicit(&peak_fds, memory_order_relaxed);
+  while (count > peak &&
+         !atomic_compare_exchange_weak_explicit(&peak_fds, &peak, count, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+  }
+}
+
+/**
+ * @brief Appends formatted text to a buffer, truncating it to fit.
+ *
+ * @param buffer[in,out] The NUL-terminated buffer to append to.
+ * @param size[in] The size of `buffer`.
+ * @param length[in,out] The length of the text in `buffer`.
+ * @param format[in] The `printf` format of the text to append.
+ */
+static void append(char* buffer, size_t size, size_t* length, const char* format, ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  int written = vsnprintf(buffer + *length, size - *length, format, arguments);
+  va_end(arguments);
+
+  if (written > 0) {
+    *length = *length + written < size ? *length + written : size - 1;
+  }
+}
+
+/**
+ * @brief Formats the device I/O counters and resource usage as `key=value` lines.
+ *
+ * @param buffer[out] The buffer to write to, NUL-terminated. Must not be empty.
+ * @param size[in] The size of `buffer`.
+ * @return The length of the text written, truncated to fit `buffer`.
+ */
+size_t format_statistics(char* buffer, size_t size) {
+  size_t length = 0;
+  *buffer = '\0';
+
+  for (size_t i = 0; i < STAT_COUNT; ++i) {
+    append(buffer, size, &length, "%s=%llu\n", statistic_names[i],
+           (unsigned long long)atomic_load_explicit(&statistics[i], memory_order_relaxed));
+  }
+
+  statistics_sample_fds();
+  struct rusage usage;
+  long peak_rss_kb = getrusage(RUSAGE_SELF, &usage) ? 0 : usage.ru_maxrss;
+#if defined(__APPLE__)
+  // Reported in bytes rather than kilobytes.
+  peak_rss_kb /= 1024;
+#endif
+
+  append(buffer, size, &length, "peak_fds=%zu\n",
+         atomic_load_explicit(&peak_fds, memory_order_relaxed));
+  append(buffer, size, &length, "peak_rss_kb=%ld\n", peak_rss_kb);
+  return length;
+}
+
+/**
+ * @brief Prints the device I/O counters and resource usage on standard error.
+ *
+ * Registered with `atexit` by `--stats`.
+ */
+void print_statistics(void) {
+  char buffer[1024];
+  format_statistics(buffer, sizeof(buffer));
+  fputs(buffer, stderr);
+}
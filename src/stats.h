@@ -0,0 +1,42 @@
+#ifndef APDBCTL_STATS_H
+#define APDBCTL_STATS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum statistic {
+  STAT_DEVICES_ENUMERATED,
+  STAT_DEVICES_OPENED,
+  STAT_DESCRIPTOR_FETCHES,
+  STAT_DESCRIPTOR_PARSES,
+  STAT_FEATURE_REPORTS_SENT,
+  STAT_FEATURE_REPORTS_RECEIVED,
+  STAT_INPUT_REPORTS_RECEIVED,
+  STAT_BYTES_SENT,
+  STAT_BYTES_RECEIVED,
+  STAT_LOCK_WAIT_NS,
+  STAT_COUNT,
+};
+
+extern bool statistics_enabled;
+extern _Atomic uint64_t statistics[STAT_COUNT];
+
+void statistics_sample_fds(void);
+size_t format_statistics(char* buffer, size_t size);
+void print_statistics(void);
+
+/**
+ * @brief Adds to a device I/O counter.
+ *
+ * Counters are always maintained: a relaxed atomic add is negligible next to the I/O it counts.
+ *
+ * @param statistic[in] The counter to add to.
+ * @param value[in] The value to add.
+ */
+static inline void statistics_add(enum statistic statistic, uint64_t value) {
+  atomic_fetch_add_explicit(&statistics[statistic], value, memory_order_relaxed);
+}
+
+#endif  // APDBCTL_STATS_H
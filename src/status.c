@@ -0,0 +1,178 @@
+#include "status.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "runtime.h"
+
+// A daemon killed while updating the page leaves the sequence odd: readers give up eventually.
+#define STATUS_READ_ATTEMPTS 1000
+
+/**
+ * @brief Creates the status page, or takes over the one of a previous daemon.
+ *
+ * The file is reused rather than replaced, so that readers that mapped it keep seeing updates
+ * across daemon restarts.
+ *
+ * @return The status page, mapped for writing, or NULL if it could not be created (e.g. without
+ *   `XDG_RUNTIME_DIR`).
+ */
+struct status_page* status_page_create(void) {
+  char path[PATH_MAX];
+  if (!runtime_path(path, sizeof(path), STATUS_PAGE_NAME, /* create_directory= */ true)) {
+    return NULL;
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, sizeof(struct status_page)) < 0) {
+    close(fd);
+    return NULL;
+  }
+  struct status_page* page =
+      mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, /* offset= */ 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    return NULL;
+  }
+
+  // A previous daemon may have been killed during an update: restart from an even sequence.
+  uint32_t sequence = atomic_load_explicit(&page->sequence, memory_order_relaxed);
+  atomic_store_explicit(&page->sequence, (sequence + 1) | 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  page->magic = STATUS_PAGE_MAGIC;
+  page->version = STATUS_PAGE_VERSION;
+  atomic_store_explicit(&page->state, STATUS_DISCONNECTED, memory_order_relaxed);
+  atomic_store_explicit(&page->pid, getpid(), memory_order_relaxed);
+  atomic_store_explicit(&page->changed_ns, realtime_ns(), memory_order_relaxed);
+  atomic_store_explicit(&page->sequence, ((sequence + 1) | 1) + 1, memory_order_release);
+  return page;
+}
+
+/**
+ * @brief Publishes the state of the display and its brightness.
+ *
+ * @param page[in,out] The status page, or NULL.
+ * @param state[in] The state of the display.
+ * @param brightness[in] The absolute brightness, or a negative value to keep the previous one.
+ */
+void status_page_publish(struct status_page* page, enum status_state state, int32_t brightness) {
+  if (!page) {
+    return;
+  }
+
+  uint64_t now_ns = realtime_ns();
+  uint32_t sequence = atomic_load_explicit(&page->sequence, memory_order_relaxed);
+  atomic_store_explicit(&page->sequence, sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  bool changed = atomic_load_explicit(&page->state, memory_order_relaxed) != (uint32_t)state;
+  if (brightness >= 0) {
+    changed |=
+        atomic_load_explicit(&page->brightness, memory_order_relaxed) != (uint32_t)brightness;
+    atomic_store_explicit(&page->brightness, brightness, memory_order_relaxed);
+    atomic_store_explicit(&page->updated_ns, now_ns, memory_order_relaxed);
+  }
+  atomic_store_explicit(&page->state, state, memory_order_relaxed);
+  if (changed) {
+    atomic_store_explicit(&page->changed_ns, now_ns, memory_order_relaxed);
+  }
+
+  atomic_store_explicit(&page->sequence, sequence + 2, memory_order_release);
+}
+
+/**
+ * @brief Marks the daemon as stopped, and unmaps the status page.
+ *
+ * @param page[in] The status page, or NULL.
+ */
+void status_page_destroy(struct status_page* page) {
+  if (!page) {
+    return;
+  }
+  status_page_publish(page, STATUS_STOPPED, -1);
+  munmap(page, sizeof(*page));
+}
+
+/**
+ * @brief Maps the status page of the daemon for reading.
+ *
+ * @return The status page, or NULL if no daemon ever published one.
+ */
+const struct status_page* status_page_map(void) {
+  char path[PATH_MAX];
+  if (!runtime_path(path, sizeof(path), STATUS_PAGE_NAME, /* create_directory= */ false)) {
+    return NULL;
+  }
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat status;
+  if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(struct status_page)) {
+    close(fd);
+    return NULL;
+  }
+  const struct status_page* page =
+      mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, /* offset= */ 0);
+  close(fd);
+  if (page == MAP_FAILED) {
+    return NULL;
+  }
+
+  if (page->magic != STATUS_PAGE_MAGIC || page->version != STATUS_PAGE_VERSION) {
+    munmap((void*)page, sizeof(*page));
+    return NULL;
+  }
+  return page;
+}
+
+/**
+ * @brief Reads a consistent copy of the status page.
+ *
+ * @param page[in] The status page.
+ * @param snapshot[out] The copy.
+ * @return Whether a consistent copy was read, i.e. the daemon did not stop in the middle of an
+ *   update.
+ */
+bool status_page_read(const struct status_page* page, struct status_snapshot* snapshot) {
+  // The page is mapped read-only: atomic loads of these sizes compile to plain loads.
+  struct status_page* fields = (struct status_page*)page;
+
+  for (int attempt = 0; attempt < STATUS_READ_ATTEMPTS; ++attempt) {
+    uint32_t begin = atomic_load_explicit(&fields->sequence, memory_order_acquire);
+    if (begin & 1) {
+      continue;
+    }
+
+    snapshot->state = atomic_load_explicit(&fields->state, memory_order_relaxed);
+    snapshot->brightness = atomic_load_explicit(&fields->brightness, memory_order_relaxed);
+    snapshot->pid = atomic_load_explicit(&fields->pid, memory_order_relaxed);
+    snapshot->changed_ns = atomic_load_explicit(&fields->changed_ns, memory_order_relaxed);
+    snapshot->updated_ns = atomic_load_explicit(&fields->updated_ns, memory_order_relaxed);
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&fields->sequence, memory_order_relaxed) == begin) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Unmaps a status page mapped with `status_page_map`.
+ *
+ * @param page[in] The status page, or NULL.
+ */
+void status_page_unmap(const struct status_page* page) {
+  if (page) {
+    munmap((void*)page, sizeof(*page));
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef APDBCTL_STATUS_H
+#define APDBCTL_STATUS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STATUS_PAGE_NAME "status"
+#define STATUS_PAGE_MAGIC 0x53424441u  // "ADBS"
+#define STATUS_PAGE_VERSION 1
+
+enum status_state {
+  STATUS_STOPPED = 0,
+  STATUS_DISCONNECTED = 1,
+  STATUS_CONNECTED = 2,
+};
+
+/**
+ * @brief The brightness published by the daemon in `$XDG_RUNTIME_DIR/apdbctl/status`.
+ *
+ * The file is mapped by the daemon for writing, and by readers for reading. Fields are guarded by
+ * a sequence lock: the daemon makes `sequence` odd while it updates them, and readers retry until
+ * they read the same even `sequence` before and after the fields. Neither side ever makes a
+ * syscall once the file is mapped.
+ *
+ * @param magic `STATUS_PAGE_MAGIC`.
+ * @param version `STATUS_PAGE_VERSION`.
+ * @param sequence The sequence lock, incremented before and after each update.
+ * @param state One of `enum status_state`.
+ * @param brightness The absolute brightness, or 0 if not known yet.
+ * @param pid The process ID of the daemon.
+ * @param changed_ns When the brightness or the state last changed, in nanoseconds since the epoch.
+ * @param updated_ns When the brightness was last read from or sent to the display, in nanoseconds
+ *   since the epoch.
+ */
+struct status_page {
+  uint32_t magic;
+  uint32_t version;
+  _Atomic uint32_t sequence;
+  _Atomic uint32_t state;
+  _Atomic uint32_t brightness;
+  _Atomic uint32_t pid;
+  _Atomic uint64_t changed_ns;
+  _Atomic uint64_t updated_ns;
+};
+
+/**
+ * @brief A consistent copy of the fields of a status page.
+ */
+struct status_snapshot {
+  enum status_state state;
+  uint32_t brightness;
+  uint32_t pid;
+  uint64_t changed_ns;
+  uint64_t updated_ns;
+};
+
+struct status_page* status_page_create(void);
+void status_page_publish(struct status_page* page, enum status_state state, int32_t brightness);
+void status_page_destroy(struct status_page* page);
+
+const struct status_page* status_page_map(void);
+bool status_page_read(const struct status_page* page, struct status_snapshot* snapshot);
+void status_page_unmap(const struct status_page* page);
+
+#endif  // APDBCTL_STATUS_H
@@ -0,0 +1,181 @@
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_MAX_EVENTS 8192
+#define TRACE_MAX_NAMES 32
+
+/**
+ * @brief A completed span.
+ *
+ * @param name The name of the span, a string literal.
+ * @param detail A description of the span subject, truncated, or empty.
+ * @param thread The small integer identifying the thread the span ran on.
+ * @param start_ns The start of the span on the monotonic clock.
+ * @param duration_ns The duration of the span.
+ */
+struct trace_event {
+  const char* name;
+  char detail[96];
+  unsigned int thread;
+  uint64_t start_ns;
+  uint64_t duration_ns;
+};
+
+bool trace_enabled = false;
+
+static const char* trace_path;
+static uint64_t trace_origin_ns;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_event trace_events[TRACE_MAX_EVENTS];
+static size_t trace_count;
+static size_t trace_dropped;
+static unsigned int trace_threads;
+static _Thread_local unsigned int trace_thread;
+
+/**
+ * @brief Records a span ending now. Only called when tracing is on, see `trace_end`.
+ *
+ * Spans past the capacity of the trace are counted but not recorded.
+ *
+ * @param name[in] The name of the span, a string literal.
+ * @param detail[in] A description of the span subject, or NULL.
+ * @param start_ns[in] The start of the span on the monotonic clock.
+ */
+void trace_record(const char* name, const char* detail, uint64_t start_ns) {
+  uint64_t end_ns = monotonic_ns();
+
+  pthread_mutex_lock(&trace_mutex);
+  if (!trace_thread) {
+    trace_thread = ++trace_threads;
+  }
+  if (trace_count == TRACE_MAX_EVENTS) {
+    ++trace_dropped;
+  } else {
+    struct trace_event* event = &trace_events[trace_count++];
+    event->name = name;
+    snprintf(event->detail, sizeof(event->detail), "%s", detail ? detail : "");
+    event->thread = trace_thread;
+    event->start_ns = start_ns;
+    event->duration_ns = end_ns - start_ns;
+  }
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+/**
+ * @brief Writes a string as a JSON string literal.
+ */
+static void write_json_string(FILE* output, const char* string) {
+  fputc('"', output);
+  for (; *string; ++string) {
+    if (*string == '"' || *string == '\\') {
+      fprintf(output, "\\%c", *string);
+    } else if ((unsigned char)*string < 0x20) {
+      fprintf(output, "\\u%04x", *string);
+    } else {
+      fputc(*string, output);
+    }
+  }
+  fputc('"', output);
+}
+
+/**
+ * @brief Prints the total duration of each kind of span on a single line of standard error.
+ */
+static void print_trace_summary(void) {
+  const char* names[TRACE_MAX_NAMES];
+  uint64_t totals_ns[TRACE_MAX_NAMES];
+  size_t counts[TRACE_MAX_NAMES];
+  size_t kinds = 0;
+
+  for (size_t i = 0; i < trace_count; ++i) {
+    size_t kind = 0;
+    while (kind < kinds && strcmp(names[kind], trace_events[i].name)) {
+      ++kind;
+    }
+    if (kind == TRACE_MAX_NAMES) {
+      continue;
+    }
+    if (kind == kinds) {
+      names[kinds] = trace_events[i].name;
+      totals_ns[kinds] = 0;
+      counts[kinds++] = 0;
+    }
+    totals_ns[kind] += trace_events[i].duration_ns;
+    ++counts[kind];
+  }
+
+  fprintf(stderr, "trace: %.3fms,", (double)(monotonic_ns() - trace_origin_ns) / 1e6);
+  for (size_t kind = 0; kind < kinds; ++kind) {
+    fprintf(stderr, " %s %.3fms", names[kind], (double)totals_ns[kind] / 1e6);
+    if (counts[kind] > 1) {
+      fprintf(stderr, " (x%zu)", counts[kind]);
+    }
+  }
+  if (trace_dropped) {
+    fprintf(stderr, ", %zu spans dropped", trace_dropped);
+  }
+  fprintf(stderr, "\n");
+}
+
+/**
+ * @brief Writes the recorded spans as Chrome trace events, at exit.
+ *
+ * The output loads in `chrome://tracing` and Perfetto. Timestamps are relative to `trace_start`.
+ */
+static void trace_write(void) {
+  pthread_mutex_lock(&trace_mutex);
+  trace_enabled = false;
+
+  FILE* output = fopen(trace_path, "w");
+  if (!output) {
+    fprintf(stderr, "error: failed to write trace to '%s'.\n", trace_path);
+    pthread_mutex_unlock(&trace_mutex);
+    return;
+  }
+
+  long pid = (long)getpid();
+  fprintf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  for (size_t i = 0; i < trace_count; ++i) {
+    const struct trace_event* event = &trace_events[i];
+    fprintf(output, "{\"name\":");
+    write_json_string(output, event->name);
+    fprintf(output, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%u",
+            PROJECT_NAME, (double)(event->start_ns - trace_origin_ns) / 1e3,
+            (double)event->duration_ns / 1e3, pid, event->thread);
+    if (*event->detail) {
+      fprintf(output, ",\"args\":{\"detail\":");
+      write_json_string(output, event->detail);
+      fprintf(output, "}");
+    }
+    fprintf(output, "}%s\n", i + 1 < trace_count ? "," : "");
+  }
+  fprintf(output, "]}\n");
+  fclose(output);
+
+  print_trace_summary();
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+/**
+ * @brief Enables tracing, until the program exits.
+ *
+ * Spans are kept in memory and written to `path` at exit, so that tracing does not perturb the
+ * operations it measures. When tracing is off, each span costs a branch.
+ *
+ * @param path[in] The file to write the trace to. Must outlive the program.
+ * @return Whether tracing was enabled.
+ */
+bool trace_start(const char* path) {
+  trace_path = path;
+  trace_origin_ns = monotonic_ns();
+  if (atexit(trace_write)) {
+    return false;
+  }
+  trace_enabled = true;
+  return true;
+}
@@ -0,0 +1,36 @@
+#ifndef APDBCTL_TRACE_H
+#define APDBCTL_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "clock.h"
+
+extern bool trace_enabled;
+
+bool trace_start(const char* path);
+void trace_record(const char* name, const char* detail, uint64_t start_ns);
+
+/**
+ * @brief Starts a trace span.
+ *
+ * @return The start of the span on the monotonic clock, or 0 when tracing is off.
+ */
+static inline uint64_t trace_begin(void) {
+  return trace_enabled ? monotonic_ns() : 0;
+}
+
+/**
+ * @brief Ends a trace span started with `trace_begin`.
+ *
+ * @param name[in] The name of the span, a string literal.
+ * @param detail[in] A description of the span subject (e.g. a device path), or NULL.
+ * @param start_ns[in] The value returned by `trace_begin`.
+ */
+static inline void trace_end(const char* name, const char* detail, uint64_t start_ns) {
+  if (trace_enabled) {
+    trace_record(name, detail, start_ns);
+  }
+}
+
+#endif  // APDBCTL_TRACE_H
@@ -0,0 +1,96 @@
+#include "verify.h"
+
+#include <stdio.h>
+
+#include "clock.h"
+#include "trace.h"
+
+// Reads back, then resends, at most this many times: with the backoff below, the display gets
+// about 150ms to settle.
+#define VERIFY_ATTEMPTS 5
+#define VERIFY_INITIAL_BACKOFF_MS 10
+
+/**
+ * @brief Confirms that a display applied a brightness, on the handle it was just sent on.
+ *
+ * The feature report is read back right after the set. While it differs, waits for the input
+ * report carrying `brightness`, which ends the wait as soon as the panel settles. Reports of other
+ * values, e.g. while the panel ramps, do not end the wait. If `brightness` was not reported once
+ * the wait is over, sends it again. The wait doubles after each attempt.
+ *
+ * @param device[in] The HID device the brightness was sent to.
+ * @param brightness[in] The absolute brightness sent.
+ * @param sent_ns[in] When the brightness was first sent, on the monotonic clock.
+ * @param statistics[out] The outcome of the verification.
+ *
+ * @retval true The display reported `brightness`.
+ * @retval false HID call failed, or the display still reported another value after all attempts.
+ */
+bool verify_brightness(struct device* device, uint32_t brightness, uint64_t sent_ns,
+                       struct verify_statistics* statistics) {
+  *statistics = (struct verify_statistics){.brightness = -1};
+  int backoff_ms = VERIFY_INITIAL_BACKOFF_MS;
+  uint64_t start_ns = trace_begin();
+
+  for (unsigned int attempt = 1;; ++attempt) {
+    int32_t current = hid_get_brightness(device);
+    ++statistics->reads;
+    if (current < 0) {
+      break;
+    }
+    statistics->brightness = current;
+    if ((uint32_t)current == brightness) {
+      statistics->confirmed = true;
+      break;
+    }
+    if (attempt == VERIFY_ATTEMPTS) {
+      break;
+    }
+
+    uint64_t deadline_ns = monotonic_ns() + backoff_ms * 1000000ull;
+    int32_t reported = BRIGHTNESS_TIMED_OUT;
+    for (uint64_t now_ns = monotonic_ns(); now_ns < deadline_ns; now_ns = monotonic_ns()) {
+      reported = hid_read_brightness(device, (int)((deadline_ns - now_ns + 999999) / 1000000));
+      if (reported < 0) {
+        break;
+      }
+      statistics->brightness = reported;
+      if ((uint32_t)reported == brightness) {
+        statistics->confirmed = true;
+        break;
+      }
+    }
+    if (reported == -1 || statistics->confirmed) {
+      break;
+    }
+
+    backoff_ms *= 2;
+    ++statistics->resends;
+    if (!hid_set_brightness(device, brightness)) {
+      break;
+    }
+  }
+
+  statistics->confirmation_ns = monotonic_ns() - sent_ns;
+  trace_end("verify", NULL, start_ns);
+  return statistics->confirmed;
+}
+
+/**
+ * @brief Prints the outcome of a verification on standard error.
+ *
+ * @param statistics[in] The outcome to print.
+ * @param brightness[in] The absolute brightness requested.
+ */
+void print_verify_statistics(const struct verify_statistics* statistics, uint32_t brightness) {
+  if (statistics->confirmed) {
+    fprintf(stderr, "verify: confirmed %u in %.3fms, %u reads, %u resends\n", brightness,
+            (double)statistics->confirmation_ns / 1e6, statistics->reads, statistics->resends);
+  } else if (statistics->brightness >= 0) {
+    fprintf(stderr,
+            "error: brightness not confirmed: display reports %d instead of %u after %.3fms.\n",
+            statistics->brightness, brightness, (double)statistics->confirmation_ns / 1e6);
+  } else {
+    fprintf(stderr, "error: brightness not confirmed: failed to read it back.\n");
+  }
+}
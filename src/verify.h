@@ -0,0 +1,30 @@
+#ifndef APDBCTL_VERIFY_H
+#define APDBCTL_VERIFY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device.h"
+
+/**
+ * @brief Outcome of a read-back verification.
+ *
+ * @param confirmed Whether the display reported the requested brightness.
+ * @param brightness The brightness the display reported last, or -1 if it could not be read.
+ * @param reads The number of feature reports read back.
+ * @param resends The number of times the brightness was sent again.
+ * @param confirmation_ns The time from the first feature report sent to the confirmation.
+ */
+struct verify_statistics {
+  bool confirmed;
+  int32_t brightness;
+  uint32_t reads;
+  uint32_t resends;
+  uint64_t confirmation_ns;
+};
+
+bool verify_brightness(struct device* device, uint32_t brightness, uint64_t sent_ns,
+                       struct verify_statistics* statistics);
+void print_verify_statistics(const struct verify_statistics* statistics, uint32_t brightness);
+
+#endif  // APDBCTL_VERIFY_H